@@ -0,0 +1,212 @@
+// Host-native microbenchmarks for lib/string.c and lib/printfmt.c.
+//
+// 'make bench-native' builds this with the library sources as a static
+// 32-bit Linux program.  There is no C library: we make the two system
+// calls we need (write and exit) ourselves, so the JOS headers and
+// library code are used unchanged.
+//
+// Each routine is timed over a sweep of sizes and alignments.  A
+// measurement repeats the call until about BATCH bytes have been
+// processed, and keeps the fastest of NSAMPLE such runs.  Output is
+// tab-separated, one measurement per line, after a header line:
+//
+//	bench	size	dalign	salign	cycles	cycles/byte
+//
+// 'cycles' is TSC cycles per call.  Routines that take one pointer
+// report its alignment as 'dalign', and 0 as 'salign'.  Lines starting
+// with '#' are comments.
+
+#include <inc/types.h>
+#include <inc/stdio.h>
+#include <inc/stdarg.h>
+#include <inc/string.h>
+#include <inc/x86.h>
+
+#define BATCH		(1 << 20)	// bytes per sample, about
+#define NSAMPLE		7		// samples per measurement
+#define BUFSIZE		(1 << 20)	// largest size tried
+#define SLOP		64		// room for misalignment and overlap
+
+#define SYS_exit	1		// i386 Linux system call numbers
+#define SYS_write	4
+
+static char dst[BUFSIZE + 2 * SLOP] __attribute__((aligned(64)));
+static char src[BUFSIZE + 2 * SLOP] __attribute__((aligned(64)));
+
+static const uint32_t sizes[] = {
+	1, 7, 16, 64, 256, 1024, 4096, 16384, 65536, 262144, 1048576
+};
+#define NSIZES (sizeof(sizes) / sizeof(sizes[0]))
+
+// Offsets from a 64-byte boundary: of the one pointer for routines
+// that take one, and of the destination and source for the others
+static const int offsets[] = { 0, 1, 7 };
+#define NOFFSETS (sizeof(offsets) / sizeof(offsets[0]))
+
+static const struct {
+	int d, s;
+} aligns[] = {
+	{ 0, 0 }, { 1, 1 }, { 0, 5 }, { 7, 0 }
+};
+#define NALIGNS (sizeof(aligns) / sizeof(aligns[0]))
+
+static int
+syscall(int num, uint32_t a1, uint32_t a2, uint32_t a3)
+{
+	int ret;
+
+	asm volatile("int $0x80"
+		: "=a" (ret)
+		: "a" (num), "b" (a1), "c" (a2), "d" (a3)
+		: "cc", "memory");
+	return ret;
+}
+
+static int
+bprintf(const char *fmt, ...)
+{
+	char buf[256];
+	va_list ap;
+	int n;
+
+	va_start(ap, fmt);
+	n = vsnprintf(buf, sizeof(buf), fmt, ap);
+	va_end(ap);
+	syscall(SYS_write, 1, (uint32_t) buf, n);
+	return n;
+}
+
+static void
+report(const char *name, uint32_t size, int dalign, int salign,
+       uint64_t best, uint32_t iters)
+{
+	uint64_t c10 = best * 10 / iters;		// tenths of a cycle
+	uint64_t cpb = best * 1000 / iters / MAX(size, 1);
+
+	bprintf("%s\t%u\t%d\t%d\t%llu.%llu\t%llu.%03llu\n",
+		name, size, dalign, salign, c10 / 10, c10 % 10,
+		cpb / 1000, cpb % 1000);
+}
+
+// Time 'expr', which processes 'size' bytes, and report it.
+#define BENCH(name, size, dalign, salign, expr)				\
+do {									\
+	uint32_t _iters = MAX(BATCH / ((size) + 1), 1), _i, _s;	\
+	uint64_t _t, _best = ~0ULL;					\
+	for (_s = 0; _s < NSAMPLE; _s++) {				\
+		_t = read_tsc();					\
+		for (_i = 0; _i < _iters; _i++)				\
+			expr;						\
+		_t = read_tsc() - _t;					\
+		if (_t < _best)						\
+			_best = _t;					\
+	}								\
+	report(name, size, dalign, salign, _best, _iters);		\
+} while (0)
+
+static void
+bench_mem(void)
+{
+	uint32_t n;
+	char *d, *s;
+	int i, j, o;
+
+	for (i = 0; i < NSIZES; i++) {
+		n = sizes[i];
+		for (j = 0; j < NOFFSETS; j++) {
+			o = offsets[j];
+			d = dst + o;
+			BENCH("memset", n, o, 0, memset(d, 0x5A, n));
+			// No match, so the whole range is searched
+			BENCH("memfind", n, o, 0, memfind(d, 0x5B, n));
+			// Overlapping, 3 bytes apart either way
+			BENCH("memmove-fwd", n, o, o + 3,
+			      memmove(d, d + 3, n));
+			BENCH("memmove-back", n, o + 3, o,
+			      memmove(d + 3, d, n));
+		}
+		for (j = 0; j < NALIGNS; j++) {
+			d = dst + aligns[j].d;
+			s = src + aligns[j].s;
+			BENCH("memcpy", n, aligns[j].d, aligns[j].s,
+			      memcpy(d, s, n));
+			// Equal contents, so the whole range is compared
+			BENCH("memcmp", n, aligns[j].d, aligns[j].s,
+			      memcmp(d, s, n));
+		}
+	}
+}
+
+static void
+bench_str(void)
+{
+	static const int salign[] = { 0, 1, 3 };
+	uint32_t n;
+	int i, j;
+
+	memset(src, 'a', sizeof(src));
+	for (i = 0; i < NSIZES; i++)
+		for (j = 0; j < sizeof(salign) / sizeof(salign[0]); j++) {
+			n = sizes[i];
+			src[salign[j] + n] = '\0';
+			BENCH("strlen", n, 0, salign[j],
+			      strlen(src + salign[j]));
+			BENCH("strfind", n, 0, salign[j],
+			      strfind(src + salign[j], 'b'));
+			src[salign[j] + n] = 'a';
+		}
+}
+
+static void
+bench_printnum(void)
+{
+	static const struct {
+		const char *name;
+		const char *fmt;
+		unsigned long long val;
+		bool wide;
+	} tests[] = {
+		{ "printnum-u", "%u", 7, 0 },
+		{ "printnum-u", "%u", 123456, 0 },
+		{ "printnum-u", "%u", 4294967295U, 0 },
+		{ "printnum-x", "%x", 0xdeadbeef, 0 },
+		{ "printnum-o", "%o", 0xdeadbeef, 0 },
+		{ "printnum-llu", "%llu", 1234567890123ULL, 1 },
+		{ "printnum-llu", "%llu", 18446744073709551615ULL, 1 },
+		{ "printnum-llx", "%llx", 0xfedcba9876543210ULL, 1 },
+		{ "printnum-llo", "%llo", 0xfedcba9876543210ULL, 1 },
+	};
+	char buf[32];
+	uint32_t n;
+	int i;
+
+	for (i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+		// The size is the number of digits printed.
+		if (tests[i].wide) {
+			n = snprintf(buf, sizeof(buf), tests[i].fmt,
+				     tests[i].val);
+			BENCH(tests[i].name, n, 0, 0,
+			      snprintf(buf, sizeof(buf), tests[i].fmt,
+				       tests[i].val));
+		} else {
+			n = snprintf(buf, sizeof(buf), tests[i].fmt,
+				     (unsigned) tests[i].val);
+			BENCH(tests[i].name, n, 0, 0,
+			      snprintf(buf, sizeof(buf), tests[i].fmt,
+				       (unsigned) tests[i].val));
+		}
+	}
+}
+
+void
+benchmain(void)
+{
+	bprintf("# string kernels: %s\n", string_init());
+	bprintf("bench\tsize\tdalign\tsalign\tcycles\tcycles/byte\n");
+	bench_mem();
+	bench_str();
+	bench_printnum();
+	syscall(SYS_exit, 0, 0, 0);
+}
+
+asm(".globl _start\n_start:\n\txorl %ebp, %ebp\n\tcall benchmain\n");
@@ -0,0 +1,144 @@
+#include <inc/x86.h>
+#include <inc/elf.h>
+#include <inc/bootinfo.h>
+
+/**********************************************************************
+ * Optional second-stage boot loader, built when BOOT2 is set in
+ * conf/env.mk.  Its job is the same as bootmain()'s: load the ELF
+ * kernel and jump to it.  The difference is that it is not limited to
+ * 510 bytes, so it can use bus-master DMA to pull the kernel off disk
+ * instead of copying every word through port I/O.
+ *
+ * DISK LAYOUT (BOOT2 builds)
+ *  * Sector 0 holds the boot block (boot.S and main.c), as usual.
+ *
+ *  * Sectors 1 through BOOT2_NSECT hold this program, as an ELF image.
+ *    The boot block loads it exactly the way it would load a kernel.
+ *
+ *  * Sector BOOT2_NSECT+1 onward holds the kernel image.
+ *
+ * If no usable PCI IDE controller is found, or a DMA transfer fails,
+ * we fall back to the boot block's PIO readseg().
+ *
+ * The kernel may also be stored compressed (KERN_LZ4 builds): a header
+ * (struct Lz4pack) followed by one LZ4 block holding the start of the
+ * ELF file, as written by boot/lz4pack.pl.  We read the whole payload,
+ * decompress it into scratch memory, and copy the segments from there.
+ **********************************************************************/
+
+#define SECTSIZE	512
+#define ELFHDR		((struct Elf *) 0x10000) // scratch space
+#define BI		((struct Bootinfo *) BOOTINFO)
+
+// Byte offset of the kernel, relative to sector 1 (where readseg()
+// and dma_readseg() start counting).
+#define KERNOFF		(BOOT2_NSECT * SECTSIZE)
+
+// Compressed kernel payload header; see boot/lz4pack.pl
+struct Lz4pack {
+	uint32_t magic;		// must equal LZ4PACK_MAGIC
+	uint32_t rawsize;	// size of the decompressed ELF image
+	uint32_t compsize;	// size of the LZ4 block that follows
+};
+#define LZ4PACK_MAGIC	0x345A4C4AU	/* "JLZ4" in little endian */
+
+// Scratch space for compressed kernels: well clear of the kernel itself
+#define LZ4BUF		((uint8_t *) 0x400000)	// compressed payload
+#define RAWBUF		((uint8_t *) 0x800000)	// decompressed ELF image
+
+void readseg(uint32_t, uint32_t, uint32_t);
+void zeroseg(uint32_t, uint32_t);
+int dma_init(void);
+int dma_readseg(uint32_t, uint32_t, uint32_t);
+int lz4_decompress(const uint8_t *, uint32_t, uint8_t *, uint32_t);
+
+static int use_dma;
+
+// Read 'count' bytes at 'offset' from the kernel into physical address
+// 'pa', by DMA if we can.
+static void
+loadseg(uint32_t pa, uint32_t count, uint32_t offset)
+{
+	if (use_dma && dma_readseg(pa, count, offset + KERNOFF) == 0)
+		return;
+	// Don't keep retrying a controller that has failed us once.
+	use_dma = 0;
+	readseg(pa, count, offset + KERNOFF);
+}
+
+// Decompress a compressed kernel and copy its segments into place.
+// Returns the ELF header of the decompressed image, or NULL on failure.
+static struct Elf *
+unpack(struct Lz4pack *lz)
+{
+	struct Elf *elf = (struct Elf *) RAWBUF;
+	struct Proghdr *ph, *eph;
+	uint8_t *src, *dst, *end;
+
+	loadseg((uint32_t) LZ4BUF, sizeof(*lz) + lz->compsize, 0);
+	lz = (struct Lz4pack *) LZ4BUF;
+	if (lz4_decompress(LZ4BUF + sizeof(*lz), lz->compsize,
+			   RAWBUF, lz->rawsize) != lz->rawsize)
+		return NULL;
+	if (elf->e_magic != ELF_MAGIC)
+		return NULL;
+
+	ph = (struct Proghdr *) ((uint8_t *) elf + elf->e_phoff);
+	eph = ph + elf->e_phnum;
+	for (; ph < eph; ph++) {
+		if (ph->p_type != ELF_PROG_LOAD)
+			continue;
+		src = RAWBUF + ph->p_offset;
+		dst = (uint8_t *) ph->p_pa;
+		for (end = dst + ph->p_filesz; dst < end; )
+			*dst++ = *src++;
+		zeroseg(ph->p_pa + ph->p_filesz, ph->p_memsz - ph->p_filesz);
+	}
+	return elf;
+}
+
+void
+boot2main(void)
+{
+	struct Proghdr *ph, *eph;
+	struct Elf *elf = ELFHDR;
+
+	use_dma = (dma_init() == 0);
+
+	// read 1st page off disk
+	loadseg((uint32_t) ELFHDR, SECTSIZE*8, 0);
+
+	if (((struct Lz4pack *) ELFHDR)->magic == LZ4PACK_MAGIC) {
+		if ((elf = unpack((struct Lz4pack *) ELFHDR)) == NULL)
+			goto bad;
+		goto run;
+	}
+
+	// is this a valid ELF?
+	if (ELFHDR->e_magic != ELF_MAGIC)
+		goto bad;
+
+	// load each program segment (ignores ph flags)
+	ph = (struct Proghdr *) ((uint8_t *) ELFHDR + ELFHDR->e_phoff);
+	eph = ph + ELFHDR->e_phnum;
+	for (; ph < eph; ph++) {
+		loadseg(ph->p_pa, ph->p_filesz, ph->p_offset);
+		zeroseg(ph->p_pa + ph->p_filesz, ph->p_memsz - ph->p_filesz);
+	}
+
+run:
+	// tell the kernel it needn't clear its BSS again
+	BI->bi_magic = BOOTINFO_MAGIC;
+	BI->bi_flags = BI_BSS_CLEAR;
+	BI->bi_tsc_handoff = read_tsc();
+
+	// call the entry point from the ELF header
+	// note: does not return!
+	((void (*)(void)) (elf->e_entry))();
+
+bad:
+	outw(0x8A00, 0x8A00);
+	outw(0x8A00, 0x8E00);
+	while (1)
+		/* do nothing */;
+}
@@ -0,0 +1,204 @@
+#include <inc/x86.h>
+
+/**********************************************************************
+ * Bus-master IDE DMA for the second-stage boot loader.
+ *
+ * We look for a PCI IDE controller whose primary channel is in
+ * compatibility mode (so the usual 0x1F0 task-file ports apply) and that
+ * can act as a bus master.  Transfers are described to the controller by
+ * a Physical Region Descriptor (PRD) table; the drive then moves the
+ * data straight into memory while we wait for the transfer to finish.
+ *
+ * See the "Programming Interface for Bus Master IDE Controller"
+ * (SFF-8038i) for the register layout used below.
+ **********************************************************************/
+
+#define SECTSIZE	512
+#define MAXSECTS	256	// most sectors one READ DMA command can move
+#define DMA_TIMEOUT	(1 << 24)	// status polls before giving up on DMA
+
+// PCI configuration space access mechanism #1
+#define PCI_CONF_ADDR	0xCF8
+#define PCI_CONF_DATA	0xCFC
+#define PCI_COMMAND	0x04	// Command/status register
+#define   PCI_COMMAND_IO	0x0001	//   I/O space enable
+#define   PCI_COMMAND_MASTER	0x0004	//   Bus master enable
+#define PCI_CLASS	0x08	// Class code/revision register
+#define PCI_BAR4	0x20	// Bus master IDE base address
+
+// Bus master IDE registers (primary channel), relative to BAR4
+#define BM_CMD		0	// Command register
+#define   BM_CMD_START	0x01	//   Start/stop bus master
+#define   BM_CMD_READ	0x08	//   Transfer from the drive to memory
+#define BM_STATUS	2	// Status register
+#define   BM_STATUS_ACT	0x01	//   Bus master active
+#define   BM_STATUS_ERR	0x02	//   Transfer error
+#define   BM_STATUS_IRQ	0x04	//   Drive raised its interrupt
+#define BM_PRDT		4	// PRD table physical address
+
+// ATA registers, status bits and commands
+#define ATA_ALTSTATUS	0x3F6	// In:	Alternate status (doesn't ack the drive)
+#define ATA_CTL		0x3F6	// Out: Device control
+#define   ATA_CTL_NIEN	0x02	//   Keep the drive off the IRQ line
+#define ATA_ERR		0x01
+#define ATA_DF		0x20
+#define ATA_BSY		0x80
+#define ATA_CMD_READ_DMA 0xC8
+
+// Physical Region Descriptor.  A region may not cross a 64KB boundary,
+// and a count of 0 means 64KB.
+struct Prd {
+	uint32_t addr;
+	uint16_t count;
+	uint16_t flags;
+};
+#define PRD_EOT		0x8000	// last entry in the table
+
+// MAXSECTS sectors span at most three 64KB-bounded regions.
+// The table itself must be 4-byte aligned and not cross 64KB.
+static struct Prd prdt[4] __attribute__((aligned(32)));
+
+static uint16_t bmbase;
+
+void waitdisk(void);
+
+static uint32_t
+pci_conf_read(uint32_t dev, uint32_t reg)
+{
+	outl(PCI_CONF_ADDR, 0x80000000 | dev | reg);
+	return inl(PCI_CONF_DATA);
+}
+
+static void
+pci_conf_write(uint32_t dev, uint32_t reg, uint32_t v)
+{
+	outl(PCI_CONF_ADDR, 0x80000000 | dev | reg);
+	outl(PCI_CONF_DATA, v);
+}
+
+// Find a bus-master capable IDE controller on PCI bus 0 and enable it.
+// Returns 0 on success, -1 if we should stick to PIO.
+int
+dma_init(void)
+{
+	uint32_t dev, class, bar;
+
+	bmbase = 0;
+	// dev holds the bus/device/function bits of a config address
+	for (dev = 0; dev < (1 << 16); dev += (1 << 8)) {
+		if ((pci_conf_read(dev, 0) & 0xFFFF) == 0xFFFF)
+			continue;
+		class = pci_conf_read(dev, PCI_CLASS);
+		// class 0x01 (mass storage), subclass 0x01 (IDE),
+		// programming interface: bus master capable (bit 7),
+		// primary channel in compatibility mode (bit 0 clear)
+		if ((class >> 16) != 0x0101 || !(class & 0x8000) ||
+		    (class & 0x0100))
+			continue;
+		bar = pci_conf_read(dev, PCI_BAR4);
+		if (!(bar & 1))		// must be an I/O space BAR
+			continue;
+		pci_conf_write(dev, PCI_COMMAND,
+			       pci_conf_read(dev, PCI_COMMAND)
+			       | PCI_COMMAND_IO | PCI_COMMAND_MASTER);
+		bmbase = bar & 0xFFFC;
+		// We poll for completion; keep the drive off the IRQ line.
+		outb(ATA_CTL, ATA_CTL_NIEN);
+		return 0;
+	}
+	return -1;
+}
+
+// Read 'nsect' (1 to MAXSECTS) sectors starting at sector 'offset'
+// into physical address 'pa' with a single READ DMA command.
+static int
+dma_readsects(uint32_t pa, uint32_t offset, uint32_t nsect)
+{
+	uint32_t len, n, end;
+	struct Prd *prd;
+	uint8_t status, ata;
+	int i;
+
+	// Describe the buffer, splitting it at 64KB boundaries.
+	prd = prdt;
+	for (len = nsect * SECTSIZE; len > 0; len -= n, pa += n, prd++) {
+		end = (pa | 0xFFFF) + 1;
+		n = (end - pa < len) ? end - pa : len;
+		prd->addr = pa;
+		prd->count = n;		// 0x10000 truncates to 0, meaning 64KB
+		prd->flags = 0;
+	}
+	prd[-1].flags = PRD_EOT;
+
+	outb(bmbase + BM_CMD, 0);
+	outl(bmbase + BM_PRDT, (uint32_t) prdt);
+	// Writing 1s clears the error and interrupt bits
+	outb(bmbase + BM_STATUS, BM_STATUS_ERR | BM_STATUS_IRQ);
+	outb(bmbase + BM_CMD, BM_CMD_READ);
+
+	waitdisk();
+	outb(0x1F2, nsect);	// count; 0 means MAXSECTS
+	outb(0x1F3, offset);
+	outb(0x1F4, offset >> 8);
+	outb(0x1F5, offset >> 16);
+	outb(0x1F6, (offset >> 24) | 0xE0);
+	outb(0x1F7, ATA_CMD_READ_DMA);
+
+	outb(bmbase + BM_CMD, BM_CMD_READ | BM_CMD_START);
+	// The drive's status isn't valid until 400ns after the command.
+	for (i = 0; i < 4; i++)
+		(void) inb(ATA_ALTSTATUS);
+
+	// With nIEN set the drive never raises INTRQ, so BM_STATUS_IRQ
+	// may never come on.  A successful transfer ends when the bus
+	// master runs off the end of the PRD table (ACT clears); a drive
+	// that aborts the command instead drops BSY with ERR or DF set,
+	// and the bus master just sits there.  Watch for both, and give
+	// up (falling back to PIO) if neither happens.
+	for (i = 0; ; i++) {
+		status = inb(bmbase + BM_STATUS);
+		if ((status & (BM_STATUS_IRQ | BM_STATUS_ERR))
+		    || !(status & BM_STATUS_ACT))
+			break;
+		ata = inb(ATA_ALTSTATUS);
+		if ((!(ata & ATA_BSY) && (ata & (ATA_ERR | ATA_DF)))
+		    || i == DMA_TIMEOUT) {
+			status |= BM_STATUS_ERR;
+			break;
+		}
+	}
+	outb(bmbase + BM_CMD, 0);
+
+	// Reading the ATA status register also acknowledges the drive.
+	if ((status & BM_STATUS_ERR) || (inb(0x1F7) & (ATA_ERR | ATA_DF)))
+		return -1;
+	return 0;
+}
+
+// Read 'count' bytes at 'offset' (relative to sector 1, as readseg()
+// counts) into physical address 'pa' by DMA.  Might copy more than
+// asked.  Returns 0 on success, -1 if the caller should retry with PIO.
+int
+dma_readseg(uint32_t pa, uint32_t count, uint32_t offset)
+{
+	uint32_t end_pa, nsect;
+
+	end_pa = pa + count;
+
+	// round down to sector boundary
+	pa &= ~(SECTSIZE - 1);
+
+	// translate from bytes to sectors, and the image starts at sector 1
+	offset = (offset / SECTSIZE) + 1;
+
+	while (pa < end_pa) {
+		nsect = (end_pa - pa + SECTSIZE - 1) / SECTSIZE;
+		if (nsect > MAXSECTS)
+			nsect = MAXSECTS;
+		if (dma_readsects(pa, offset, nsect) < 0)
+			return -1;
+		pa += nsect * SECTSIZE;
+		offset += nsect;
+	}
+	return 0;
+}
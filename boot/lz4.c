@@ -0,0 +1,70 @@
+#include <inc/types.h>
+
+/**********************************************************************
+ * LZ4 block decompressor for the second-stage boot loader.
+ *
+ * A block is a series of sequences.  Each one starts with a token byte
+ * whose high nibble is a literal length and low nibble a match length
+ * (minus 4); a nibble of 15 means more length bytes follow, each adding
+ * up to 255.  The literals come next, then a 2-byte little-endian
+ * offset back into the output, from which the match is copied.  The
+ * last sequence has literals only.
+ *
+ * boot/lz4pack.pl produces these blocks at build time.
+ **********************************************************************/
+
+static uint32_t
+getlen(const uint8_t **sp, const uint8_t *send, uint32_t n)
+{
+	uint8_t b;
+
+	if (n != 15)
+		return n;
+	do {
+		if (*sp >= send)
+			return ~0;
+		b = *(*sp)++;
+		n += b;
+	} while (b == 255);
+	return n;
+}
+
+// Decompress the 'srclen'-byte block at 'src' into 'dst', which has
+// room for 'dstlen' bytes.  Returns the number of bytes produced,
+// or -1 if the block is malformed.
+int
+lz4_decompress(const uint8_t *src, uint32_t srclen, uint8_t *dst, uint32_t dstlen)
+{
+	const uint8_t *send = src + srclen;
+	uint8_t *d = dst, *dend = dst + dstlen;
+	const uint8_t *m;
+	uint32_t tok, n;
+
+	while (src < send) {
+		tok = *src++;
+
+		// literals
+		n = getlen(&src, send, tok >> 4);
+		if (n > (uint32_t) (send - src) || n > (uint32_t) (dend - d))
+			return -1;
+		while (n-- > 0)
+			*d++ = *src++;
+		if (src == send)
+			break;		// the last sequence has no match
+
+		// match
+		if (send - src < 2)
+			return -1;
+		m = d - (src[0] | (src[1] << 8));
+		src += 2;
+		if (m < dst || m == d)
+			return -1;
+		n = getlen(&src, send, tok & 15);
+		if (n == ~0U || n + 4 > (uint32_t) (dend - d))
+			return -1;
+		// matches may overlap their own output, so copy bytewise
+		for (n += 4; n > 0; n--)
+			*d++ = *m++;
+	}
+	return d - dst;
+}
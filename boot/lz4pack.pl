@@ -0,0 +1,99 @@
+#!/usr/bin/perl
+#
+# lz4pack.pl: compress an ELF kernel for the second-stage boot loader.
+#
+# Usage: lz4pack.pl kernel kernel.lz4
+#
+# Only the part of the file the loader needs is kept: everything up to
+# the end of the last loadable segment.  That prefix is compressed as a
+# single LZ4 block and written out behind a 12-byte header:
+#
+#	uint32_t magic;		// LZ4PACK_MAGIC in boot/boot2.c
+#	uint32_t rawsize;	// bytes of ELF image after decompression
+#	uint32_t compsize;	// bytes of LZ4 block that follow
+#
+# The compressor is a plain greedy matcher with a 4-byte hash; it is not
+# as tight as the reference lz4 tool but needs nothing beyond Perl.
+
+use strict;
+
+my $MAGIC = 0x345A4C4A;		# "JLZ4"
+my $MINMATCH = 4;
+my $MAXOFF = 65535;
+my $LASTLITERALS = 5;		# the block must end with 5 literals ...
+my $MFLIMIT = 12;		# ... and the last match must start 12 before
+
+open(IN, $ARGV[0]) || die "open $ARGV[0]: $!";
+binmode IN;
+my $elf;
+{ local $/; $elf = <IN>; }
+close IN;
+
+die "$ARGV[0]: not an ELF file\n" if substr($elf, 0, 4) ne "\x7FELF";
+
+# Find the end of the last PT_LOAD segment.
+my ($phoff) = unpack("V", substr($elf, 28, 4));
+my ($phentsize, $phnum) = unpack("vv", substr($elf, 42, 4));
+my $rawsize = 0;
+for (my $i = 0; $i < $phnum; $i++) {
+	my ($type, $off, $va, $pa, $filesz) =
+	    unpack("V5", substr($elf, $phoff + $i * $phentsize, 20));
+	next if $type != 1;
+	$rawsize = $off + $filesz if $off + $filesz > $rawsize;
+}
+$elf = substr($elf, 0, $rawsize);
+
+sub lenbytes {
+	my ($n) = @_;
+	my $s = "";
+	while ($n >= 255) {
+		$s .= "\xFF";
+		$n -= 255;
+	}
+	return $s . chr($n);
+}
+
+sub sequence {
+	my ($lit, $mlen, $off) = @_;
+	my $llen = length($lit);
+	my $tok = ($llen < 15 ? $llen : 15) << 4;
+	$tok |= defined($mlen) ? ($mlen - $MINMATCH < 15 ? $mlen - $MINMATCH : 15) : 0;
+	my $s = chr($tok);
+	$s .= lenbytes($llen - 15) if $llen >= 15;
+	$s .= $lit;
+	if (defined($mlen)) {
+		$s .= pack("v", $off);
+		$s .= lenbytes($mlen - $MINMATCH - 15) if $mlen - $MINMATCH >= 15;
+	}
+	return $s;
+}
+
+my %last;
+my $out = "";
+my $anchor = 0;
+my $p = 0;
+my $n = length($elf);
+while ($p + $MFLIMIT < $n) {
+	my $key = substr($elf, $p, $MINMATCH);
+	my $cand = $last{$key};
+	$last{$key} = $p;
+	if (!defined($cand) || $p - $cand > $MAXOFF) {
+		$p++;
+		next;
+	}
+	my $mlen = $MINMATCH;
+	my $limit = $n - $LASTLITERALS;
+	$mlen++ while $p + $mlen < $limit
+	    && substr($elf, $cand + $mlen, 1) eq substr($elf, $p + $mlen, 1);
+	$out .= sequence(substr($elf, $anchor, $p - $anchor), $mlen, $p - $cand);
+	$p += $mlen;
+	$anchor = $p;
+}
+$out .= sequence(substr($elf, $anchor));
+
+open(OUT, ">$ARGV[1]") || die "open >$ARGV[1]: $!";
+binmode OUT;
+print OUT pack("VVV", $MAGIC, $rawsize, length($out)), $out;
+close OUT;
+
+printf STDERR "kernel compressed %d -> %d bytes\n", $rawsize, length($out) + 12;
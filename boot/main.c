@@ -1,5 +1,6 @@
 #include <inc/x86.h>
 #include <inc/elf.h>
+#include <inc/bootinfo.h>
 
 /**********************************************************************
  * This a dirt simple boot loader, whose sole job is to boot
@@ -27,19 +28,26 @@
  *    and a stack so C code then run, then calls bootmain()
  *
  *  * bootmain() in this file takes over, reads in the kernel and jumps to it.
+ *    Only the file-backed part of each segment is read; the rest (BSS)
+ *    is zeroed here, and the kernel is told so through struct Bootinfo.
  **********************************************************************/
 
 #define SECTSIZE	512
+#define MAXSECTS	256	// most sectors one READ SECTORS command can move
 #define ELFHDR		((struct Elf *) 0x10000) // scratch space
+#define BI		((struct Bootinfo *) BOOTINFO)
 
-void readsect(void*, uint32_t);
+void readsects(void*, uint32_t, uint32_t);
 void readseg(uint32_t, uint32_t, uint32_t);
+void zeroseg(uint32_t, uint32_t);
 
 void
 bootmain(void)
 {
 	struct Proghdr *ph, *eph;
 
+	BI->bi_tsc_start = read_tsc();
+
 	// read 1st page off disk
 	readseg((uint32_t) ELFHDR, SECTSIZE*8, 0);
 
@@ -50,10 +58,17 @@ bootmain(void)
 	// load each program segment (ignores ph flags)
 	ph = (struct Proghdr *) ((uint8_t *) ELFHDR + ELFHDR->e_phoff);
 	eph = ph + ELFHDR->e_phnum;
-	for (; ph < eph; ph++)
+	for (; ph < eph; ph++) {
 		// p_pa is the load address of this segment (as well
 		// as the physical address)
-		readseg(ph->p_pa, ph->p_memsz, ph->p_offset);
+		readseg(ph->p_pa, ph->p_filesz, ph->p_offset);
+		zeroseg(ph->p_pa + ph->p_filesz, ph->p_memsz - ph->p_filesz);
+	}
+
+	// tell the kernel it needn't clear its BSS again
+	BI->bi_magic = BOOTINFO_MAGIC;
+	BI->bi_flags = BI_BSS_CLEAR;
+	BI->bi_tsc_handoff = read_tsc();
 
 	// call the entry point from the ELF header
 	// note: does not return!
@@ -71,7 +86,7 @@ bad:
 void
 readseg(uint32_t pa, uint32_t count, uint32_t offset)
 {
-	uint32_t end_pa;
+	uint32_t end_pa, nsect;
 
 	end_pa = pa + count;
 
@@ -81,20 +96,40 @@ readseg(uint32_t pa, uint32_t count, uint32_t offset)
 	// translate from bytes to sectors, and kernel starts at sector 1
 	offset = (offset / SECTSIZE) + 1;
 
-	// If this is too slow, we could read lots of sectors at a time.
+	// Read up to MAXSECTS sectors per disk command, so the per-command
+	// handshake is paid once per 128KB rather than once per sector.
 	// We'd write more to memory than asked, but it doesn't matter --
 	// we load in increasing order.
 	while (pa < end_pa) {
+		nsect = (end_pa - pa + SECTSIZE - 1) / SECTSIZE;
+		if (nsect > MAXSECTS)
+			nsect = MAXSECTS;
 		// Since we haven't enabled paging yet and we're using
 		// an identity segment mapping (see boot.S), we can
 		// use physical addresses directly.  This won't be the
 		// case once JOS enables the MMU.
-		readsect((uint8_t*) pa, offset);
-		pa += SECTSIZE;
-		offset++;
+		readsects((uint8_t*) pa, offset, nsect);
+		pa += nsect * SECTSIZE;
+		offset += nsect;
 	}
 }
 
+// Zero 'count' bytes at physical address 'pa', a word at a time once
+// 'pa' is aligned.  Might clear up to 3 bytes more than asked, which
+// doesn't matter -- we load in increasing order.
+void
+zeroseg(uint32_t pa, uint32_t count)
+{
+	uint32_t head = -pa & 3;
+
+	if (head > count)
+		head = count;
+	asm volatile("cld; rep stosb; movl %3, %%ecx; rep stosl"
+		     : "+D" (pa), "+c" (head)
+		     : "a" (0), "r" ((count - head + 3) / 4)
+		     : "cc", "memory");
+}
+
 void
 waitdisk(void)
 {
@@ -103,23 +138,26 @@ waitdisk(void)
 		/* do nothing */;
 }
 
+// Read 'nsect' (1 to MAXSECTS) consecutive sectors starting at sector
+// 'offset' into 'dst' with a single READ SECTORS command.
 void
-readsect(void *dst, uint32_t offset)
+readsects(void *dst, uint32_t offset, uint32_t nsect)
 {
 	// wait for disk to be ready
 	waitdisk();
 
-	outb(0x1F2, 1);		// count = 1
+	outb(0x1F2, nsect);	// count; 0 means MAXSECTS
 	outb(0x1F3, offset);
 	outb(0x1F4, offset >> 8);
 	outb(0x1F5, offset >> 16);
 	outb(0x1F6, (offset >> 24) | 0xE0);
 	outb(0x1F7, 0x20);	// cmd 0x20 - read sectors
 
-	// wait for disk to be ready
-	waitdisk();
-
-	// read a sector
-	insl(0x1F0, dst, SECTSIZE/4);
+	// The drive signals each sector separately, so drain them
+	// one at a time as they become ready.
+	do {
+		waitdisk();
+		insl(0x1F0, dst, SECTSIZE/4);
+		dst = (uint8_t*) dst + SECTSIZE;
+	} while (--nsect > 0);
 }
-
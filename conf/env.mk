@@ -18,3 +18,24 @@ V = @
 # following line and set it to the full path to QEMU.
 #
 # QEMU=
+
+# Uncomment the following line to boot through the second-stage loader
+# in boot/boot2.c, which loads the kernel by bus-master DMA when it finds
+# a PCI IDE controller, and by PIO otherwise.
+#
+# BOOT2=1
+
+# Uncomment the following line to store the kernel LZ4-compressed on disk
+# and have the second-stage loader (implied) decompress it at boot.
+#
+# KERN_LZ4=1
+
+# Serial console speed in bits per second; it must divide 115200.
+# The 'baud' monitor command changes it at run time.
+#
+# COM_BAUD=9600
+
+# Size of the kernel log that holds console output (the 'dmesg' monitor
+# command shows it); it must be a power of 2.
+#
+# KLOG_SIZE=65536
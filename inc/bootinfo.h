@@ -0,0 +1,23 @@
+#ifndef JOS_INC_BOOTINFO_H
+#define JOS_INC_BOOTINFO_H
+
+#include <inc/types.h>
+
+// The JOS boot loader leaves a struct Bootinfo at physical address
+// BOOTINFO, just below its own stack, to tell the kernel what work it
+// has already done.  Other loaders (e.g., GRUB) don't, so the kernel
+// must check bi_magic before trusting anything else in it.
+#define BOOTINFO	0x7000
+#define BOOTINFO_MAGIC	0x4F4F424AU	/* "JBOO" in little endian */
+
+struct Bootinfo {
+	uint32_t bi_magic;	// must equal BOOTINFO_MAGIC
+	uint32_t bi_flags;
+	uint64_t bi_tsc_start;	// TSC when the boot loader's C code began
+	uint64_t bi_tsc_handoff; // TSC just before jumping to the kernel
+};
+
+// Flag bits for Bootinfo::bi_flags
+#define BI_BSS_CLEAR	0x1	// every segment's BSS has been zeroed
+
+#endif /* !JOS_INC_BOOTINFO_H */
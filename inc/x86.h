@@ -34,6 +34,11 @@ static __inline uint32_t read_ebp(void) __attribute__((always_inline));
 static __inline uint32_t read_esp(void) __attribute__((always_inline));
 static __inline void cpuid(uint32_t info, uint32_t *eaxp, uint32_t *ebxp, uint32_t *ecxp, uint32_t *edxp);
 static __inline uint64_t read_tsc(void) __attribute__((always_inline));
+static __inline uint64_t rdmsr(uint32_t msr) __attribute__((always_inline));
+static __inline void wrmsr(uint32_t msr, uint64_t val) __attribute__((always_inline));
+static __inline uint64_t rdpmc(uint32_t counter) __attribute__((always_inline));
+static __inline uint64_t xgetbv(uint32_t xcr) __attribute__((always_inline));
+static __inline void xsetbv(uint32_t xcr, uint64_t val) __attribute__((always_inline));
 
 static __inline void
 breakpoint(void)
@@ -259,9 +264,10 @@ static __inline void
 cpuid(uint32_t info, uint32_t *eaxp, uint32_t *ebxp, uint32_t *ecxp, uint32_t *edxp)
 {
 	uint32_t eax, ebx, ecx, edx;
+	// Leaves with subleaves (such as 7) get subleaf 0.
 	asm volatile("cpuid"
 		: "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx)
-		: "a" (info));
+		: "a" (info), "c" (0));
 	if (eaxp)
 		*eaxp = eax;
 	if (ebxp)
@@ -280,6 +286,42 @@ read_tsc(void)
 	return tsc;
 }
 
+static __inline uint64_t
+rdmsr(uint32_t msr)
+{
+	uint64_t val;
+	__asm __volatile("rdmsr" : "=A" (val) : "c" (msr));
+	return val;
+}
+
+static __inline void
+wrmsr(uint32_t msr, uint64_t val)
+{
+	__asm __volatile("wrmsr" : : "c" (msr), "A" (val));
+}
+
+static __inline uint64_t
+rdpmc(uint32_t counter)
+{
+	uint64_t val;
+	__asm __volatile("rdpmc" : "=A" (val) : "c" (counter));
+	return val;
+}
+
+static __inline uint64_t
+xgetbv(uint32_t xcr)
+{
+	uint64_t val;
+	__asm __volatile("xgetbv" : "=A" (val) : "c" (xcr));
+	return val;
+}
+
+static __inline void
+xsetbv(uint32_t xcr, uint64_t val)
+{
+	__asm __volatile("xsetbv" : : "c" (xcr), "A" (val));
+}
+
 static inline uint32_t
 xchg(volatile uint32_t *addr, uint32_t newval)
 {
@@ -293,4 +335,16 @@ xchg(volatile uint32_t *addr, uint32_t newval)
 	return result;
 }
 
+// Atomically add 'n' to *addr and return the value *addr had before.
+// Also a compiler barrier: memory accesses are not moved across it.
+static inline uint32_t
+xadd(volatile uint32_t *addr, uint32_t n)
+{
+	asm volatile("lock; xaddl %0, %1" :
+			"+r" (n), "+m" (*addr) :
+			:
+			"cc", "memory");
+	return n;
+}
+
 #endif /* !JOS_INC_X86_H */
@@ -0,0 +1,89 @@
+// Boot-time tracing: a handful of TSC timestamps taken from the boot
+// loader up to the first monitor prompt, so we can see where boot
+// time goes.
+
+#include <inc/stdio.h>
+#include <inc/x86.h>
+#include <inc/bootinfo.h>
+
+#include <kern/boottrace.h>
+#include <kern/tsc.h>
+
+#define NBOOTTRACE	16
+
+struct Boottrace {
+	const char *what;	// phase that ended at this point
+	uint64_t tsc;
+};
+
+// i386_init() records its first points before it clears BSS
+// (if it clears it at all), so keep the table in .data.
+static struct {
+	struct Boottrace pt[NBOOTTRACE];
+	int n;
+	bool done;
+} trace __attribute__((section(".data")));
+
+static void
+record(const char *what, uint64_t tsc)
+{
+	if (trace.done || trace.n == NBOOTTRACE)
+		return;
+	trace.pt[trace.n].what = what;
+	trace.pt[trace.n].tsc = tsc;
+	trace.n++;
+}
+
+void
+boottrace_init(const struct Bootinfo *bi)
+{
+	extern uint64_t entry_tsc;	// stamped by entry.S
+	uint64_t now = read_tsc();
+
+	trace.n = 0;
+	trace.done = 0;
+	// Only our own boot loader leaves timestamps behind.
+	if (bi->bi_magic == BOOTINFO_MAGIC) {
+		record("boot loader start", bi->bi_tsc_start);
+		record("boot loader", bi->bi_tsc_handoff);
+	}
+	record("kernel handoff", entry_tsc);
+	record("entry.S", now);
+}
+
+void
+boottrace(const char *what)
+{
+	record(what, read_tsc());
+}
+
+void
+boottrace_end(const char *what)
+{
+	record(what, read_tsc());
+	trace.done = 1;
+}
+
+void
+boottrace_print(void)
+{
+	uint64_t start, delta;
+	int i;
+
+	if (trace.n == 0) {
+		cprintf("No boot trace recorded\n");
+		return;
+	}
+	start = trace.pt[0].tsc;
+	if (tsc_khz())
+		cprintf("Boot phases (TSC at %u kHz):\n", tsc_khz());
+	else
+		cprintf("Boot phases (TSC rate unknown, no times in us):\n");
+	cprintf("  %-20s %12s %10s %10s\n", "phase", "cycles", "us", "total us");
+	for (i = 1; i < trace.n; i++) {
+		delta = trace.pt[i].tsc - trace.pt[i - 1].tsc;
+		cprintf("  %-20s %12llu %10llu %10llu\n", trace.pt[i].what,
+			delta, tsc_to_us(delta),
+			tsc_to_us(trace.pt[i].tsc - start));
+	}
+}
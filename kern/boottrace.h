@@ -0,0 +1,19 @@
+#ifndef JOS_KERN_BOOTTRACE_H
+#define JOS_KERN_BOOTTRACE_H
+#ifndef JOS_KERNEL
+# error "This is a JOS kernel header; user programs should not #include it"
+#endif
+
+struct Bootinfo;
+
+// Boot-time tracepoints.  boottrace_init() starts the timeline with the
+// boot loader's and entry.S's timestamps; boottrace(what) then marks the
+// end of phase 'what'.  boottrace_end() marks the last phase and stops
+// recording, so it may safely be called more than once.
+// All of these may be called before BSS has been cleared.
+void boottrace_init(const struct Bootinfo *bi);
+void boottrace(const char *what);
+void boottrace_end(const char *what);
+void boottrace_print(void);
+
+#endif	// !JOS_KERN_BOOTTRACE_H
@@ -1,15 +1,17 @@
 /* See COPYRIGHT for copyright information. */
 
 #include <inc/x86.h>
+#include <inc/mmu.h>
 #include <inc/memlayout.h>
 #include <inc/kbdreg.h>
 #include <inc/string.h>
 #include <inc/assert.h>
+#include <inc/error.h>
 
 #include <kern/console.h>
+#include <kern/klog.h>
 
 static void cons_intr(int (*proc)(void));
-static void cons_putc(int c);
 
 // Stupid I/O delay routine necessitated by historical PC design flaws
 static void
@@ -32,7 +34,12 @@ delay(void)
 #define COM_IER		1	// Out: Interrupt Enable Register
 #define   COM_IER_RDI	0x01	//   Enable receiver data interrupt
 #define COM_IIR		2	// In:	Interrupt ID Register
+#define   COM_IIR_FIFO	0xC0	//   FIFOs enabled (16550A and later)
 #define COM_FCR		2	// Out: FIFO Control Register
+#define   COM_FCR_ENABLE 0x01	//   Enable the FIFOs
+#define   COM_FCR_RXCLR	0x02	//   Clear the receive FIFO
+#define   COM_FCR_TXCLR	0x04	//   Clear the transmit FIFO
+#define   COM_FCR_TRIG14 0xC0	//   Receive interrupt at 14 bytes
 #define COM_LCR		3	// Out: Line Control Register
 #define	  COM_LCR_DLAB	0x80	//   Divisor latch access bit
 #define	  COM_LCR_WLEN8	0x03	//   Wordlength: 8 bits
@@ -45,7 +52,24 @@ delay(void)
 #define   COM_LSR_TXRDY	0x20	//   Transmit buffer avail
 #define   COM_LSR_TSRE	0x40	//   Transmitter off
 
+#define COM_FIFOSIZE	16	// 16550A transmit FIFO depth
+#define COM_CLOCK	115200	// divisor 1 gives this many bits per second
+
+// Line speed at boot; set COM_BAUD in conf/env.mk to change it.
+// The default must match the GNUmakefile's.
+#ifndef COM_BAUD
+#define COM_BAUD	115200
+#endif
+
+// Give up waiting for the transmitter after this many delay()s
+// per unit of divisor per byte it is sending, so the timeout
+// tracks the time the bytes actually take on the wire.
+#define COM_DELAYS_PER_DIV 1067	// 12800 at 9600 baud, as ever
+
 static bool serial_exists;
+static int serial_fifo;		// bytes the transmitter takes at a time
+static int serial_divisor;	// COM_CLOCK / bits per second
+static int serial_txwait;	// delay()s before giving up on the UART
 
 static int
 serial_proc_data(void)
@@ -55,6 +79,16 @@ serial_proc_data(void)
 	return inb(COM1+COM_RX);
 }
 
+// Wait, but not forever, for the line status register to show 'bit'.
+static void
+serial_wait(int bit)
+{
+	int i;
+
+	for (i = 0; !(inb(COM1 + COM_LSR) & bit) && i < serial_txwait; i++)
+		delay();
+}
+
 void
 serial_intr(void)
 {
@@ -62,33 +96,70 @@ serial_intr(void)
 		cons_intr(serial_proc_data);
 }
 
+// Send 'len' bytes, a FIFO-full at a time, polling the transmitter.
+// A 16550A reports COM_LSR_TXRDY only once its FIFO is empty.
 static void
-serial_putc(int c)
+serial_write(const char *buf, int len)
 {
-	int i;
+	int n;
 
-	for (i = 0;
-	     !(inb(COM1 + COM_LSR) & COM_LSR_TXRDY) && i < 12800;
-	     i++)
-		delay();
+	if (!serial_exists)
+		return;
 
-	outb(COM1 + COM_TX, c);
+	while (len > 0) {
+		serial_wait(COM_LSR_TXRDY);
+		for (n = 0; n < serial_fifo && len > 0; n++, len--)
+			outb(COM1 + COM_TX, *buf++);
+	}
 }
 
 static void
-serial_init(void)
+serial_set_divisor(int divisor)
 {
-	// Turn off the FIFO
-	outb(COM1+COM_FCR, 0);
-
 	// Set speed; requires DLAB latch
 	outb(COM1+COM_LCR, COM_LCR_DLAB);
-	outb(COM1+COM_DLL, (uint8_t) (115200 / 9600));
-	outb(COM1+COM_DLM, 0);
+	outb(COM1+COM_DLL, (uint8_t) divisor);
+	outb(COM1+COM_DLM, (uint8_t) (divisor >> 8));
 
 	// 8 data bits, 1 stop bit, parity off; turn off DLAB latch
 	outb(COM1+COM_LCR, COM_LCR_WLEN8 & ~COM_LCR_DLAB);
 
+	serial_divisor = divisor;
+	serial_txwait = COM_DELAYS_PER_DIV * divisor * serial_fifo;
+}
+
+// Change the serial line speed to 'baud' bits per second,
+// which must divide COM_CLOCK evenly.
+int
+serial_set_baud(int baud)
+{
+	if (baud <= 0 || baud > COM_CLOCK || COM_CLOCK % baud != 0)
+		return -E_INVAL;
+	// Let everything sent at the old speed go out first
+	serial_wait(COM_LSR_TSRE);
+	serial_set_divisor(COM_CLOCK / baud);
+	return 0;
+}
+
+int
+serial_baud(void)
+{
+	return COM_CLOCK / serial_divisor;
+}
+
+static bool
+serial_init(void)
+{
+	// Turn on the FIFOs, discarding anything already in them
+	outb(COM1+COM_FCR, COM_FCR_ENABLE | COM_FCR_RXCLR | COM_FCR_TXCLR
+	     | COM_FCR_TRIG14);
+
+	// Older UARTs (8250, 16450) have no FIFO: one byte at a time
+	serial_fifo = ((inb(COM1+COM_IIR) & COM_IIR_FIFO) == COM_IIR_FIFO
+		       ? COM_FIFOSIZE : 1);
+
+	serial_set_divisor(COM_CLOCK / COM_BAUD);
+
 	// No modem controls
 	outb(COM1+COM_MCR, 0);
 	// Enable rcv interrupts
@@ -100,6 +171,7 @@ serial_init(void)
 	(void) inb(COM1+COM_IIR);
 	(void) inb(COM1+COM_RX);
 
+	return serial_exists;
 }
 
 
@@ -108,16 +180,32 @@ serial_init(void)
 // For information on PC parallel port programming, see the class References
 // page.
 
+#define LPT1		0x378
+
+// A parallel port's data register reads back what was last written
+// to it; with no port there, the bus floats (usually to 0xFF).
+static bool
+lpt_init(void)
+{
+	outb(LPT1+0, 0x55);
+	if (inb(LPT1+0) != 0x55)
+		return 0;
+	outb(LPT1+0, 0xAA);
+	return inb(LPT1+0) == 0xAA;
+}
+
 static void
-lpt_putc(int c)
+lpt_write(const char *buf, int len)
 {
 	int i;
 
-	for (i = 0; !(inb(0x378+1) & 0x80) && i < 12800; i++)
-		delay();
-	outb(0x378+0, c);
-	outb(0x378+2, 0x08|0x04|0x01);
-	outb(0x378+2, 0x08);
+	for (; len > 0; len--) {
+		for (i = 0; !(inb(LPT1+1) & 0x80) && i < 12800; i++)
+			delay();
+		outb(LPT1+0, *buf++);
+		outb(LPT1+2, 0x08|0x04|0x01);
+		outb(LPT1+2, 0x08);
+	}
 }
 
 
@@ -125,16 +213,47 @@ lpt_putc(int c)
 
 /***** Text-mode CGA/VGA display output *****/
 
+// Characters are written to a shadow copy of the screen in ordinary
+// RAM, and only copied out to the (slow) display memory, a line at a
+// time, when the console is flushed.  The shadow is a ring of rows:
+// scrolling just moves crt_top instead of copying the screen.
+//
+// Display memory is scrolled the same way.  The screen is a window
+// onto it that starts at crt_origin, which the 6845's start address
+// registers follow; scrolling moves the window down a line, so only
+// the new bottom line has to be written.  When the window reaches the
+// end of display memory it goes back to the start, and that one
+// scroll rewrites the whole screen.  A monochrome adapter has no
+// memory to spare, so there every scroll rewrites the screen.
+
+#define CGA_MEMSIZE	16384	// bytes of display memory on a CGA
+#define MONO_MEMSIZE	4096	// ... and on a monochrome adapter
+
 static unsigned addr_6845;
 static uint16_t *crt_buf;
 static uint16_t crt_pos;
 
-static void
+static uint16_t crt_shadow[CRT_SIZE];
+static int crt_top;		// shadow row shown on the top screen line
+static uint32_t crt_dirty;	// bit r set: screen line r needs copying
+static uint16_t crt_cursor;	// cursor address the 6845 has
+static uint16_t crt_vsize;	// display memory cells we scroll through
+static uint16_t crt_origin;	// display memory cell at the top left
+static uint16_t crt_start;	// start address the 6845 has
+
+// Address of screen line 'row' in the shadow
+static uint16_t *
+cga_line(int row)
+{
+	return crt_shadow + ((crt_top + row) % CRT_ROWS) * CRT_COLS;
+}
+
+static bool
 cga_init(void)
 {
 	volatile uint16_t *cp;
 	uint16_t was;
-	unsigned pos;
+	unsigned pos, memsize;
 
 	cp = (uint16_t*) (KERNBASE + CGA_BUF);
 	was = *cp;
@@ -142,9 +261,11 @@ cga_init(void)
 	if (*cp != 0xA55A) {
 		cp = (uint16_t*) (KERNBASE + MONO_BUF);
 		addr_6845 = MONO_BASE;
+		memsize = MONO_MEMSIZE;
 	} else {
 		*cp = was;
 		addr_6845 = CGA_BASE;
+		memsize = CGA_MEMSIZE;
 	}
 
 	/* Extract cursor location */
@@ -155,57 +276,117 @@ cga_init(void)
 
 	crt_buf = (uint16_t*) cp;
 	crt_pos = pos;
+	crt_cursor = pos;
+
+	// Start the shadow from whatever is on the screen now.  The BIOS
+	// leaves the screen at the start of display memory; make sure of
+	// it, since the start address can't be read back on a real 6845.
+	memmove(crt_shadow, crt_buf, sizeof(crt_shadow));
+	crt_top = 0;
+	crt_dirty = 0;
+	crt_vsize = memsize / sizeof(uint16_t) / CRT_COLS * CRT_COLS;
+	crt_origin = 0;
+	crt_start = 0;
+	outb(addr_6845, 12);
+	outb(addr_6845 + 1, 0);
+	outb(addr_6845, 13);
+	outb(addr_6845 + 1, 0);
+
+	return 1;
 }
 
 
 
 static void
-cga_putc(int c)
+cga_write(const char *buf, int len)
 {
-	// if no attribute given, then use black on white
-	if (!(c & ~0xFF))
-		c |= 0x0700;
+	uint16_t *line;
+	int c, i, n;
+
+	for (; len > 0; len--) {
+		// black on white; a tab is five spaces
+		c = 0x0700 | *(unsigned char *) buf++;
+		n = 1;
+		if ((c & 0xff) == '\t') {
+			c = 0x0700 | ' ';
+			n = 5;
+		}
 
-	switch (c & 0xff) {
-	case '\b':
-		if (crt_pos > 0) {
-			crt_pos--;
-			crt_buf[crt_pos] = (c & ~0xff) | ' ';
+		for (; n > 0; n--) {
+			switch (c & 0xff) {
+			case '\b':
+				if (crt_pos > 0) {
+					crt_pos--;
+					cga_line(crt_pos / CRT_COLS)[crt_pos % CRT_COLS] = (c & ~0xff) | ' ';
+					crt_dirty |= 1 << (crt_pos / CRT_COLS);
+				}
+				break;
+			case '\n':
+				crt_pos += CRT_COLS;
+				/* fallthru */
+			case '\r':
+				crt_pos -= (crt_pos % CRT_COLS);
+				break;
+			default:
+				/* write the character */
+				cga_line(crt_pos / CRT_COLS)[crt_pos % CRT_COLS] = c;
+				crt_dirty |= 1 << (crt_pos / CRT_COLS);
+				crt_pos++;
+				break;
+			}
+
+			// Scroll: the old top line becomes the new, blank,
+			// bottom line.
+			if (crt_pos < CRT_SIZE)
+				continue;
+			line = cga_line(0);
+			for (i = 0; i < CRT_COLS; i++)
+				line[i] = 0x0700 | ' ';
+			crt_top = (crt_top + 1) % CRT_ROWS;
+			crt_pos -= CRT_COLS;
+
+			// Lines still to be copied move up with the text;
+			// the new bottom line is the only other change.
+			if (crt_origin + CRT_SIZE + CRT_COLS <= crt_vsize) {
+				crt_origin += CRT_COLS;
+				crt_dirty = (crt_dirty >> 1) | (1 << (CRT_ROWS - 1));
+			} else {
+				crt_origin = 0;
+				crt_dirty = (1 << CRT_ROWS) - 1;
+			}
 		}
-		break;
-	case '\n':
-		crt_pos += CRT_COLS;
-		/* fallthru */
-	case '\r':
-		crt_pos -= (crt_pos % CRT_COLS);
-		break;
-	case '\t':
-		cons_putc(' ');
-		cons_putc(' ');
-		cons_putc(' ');
-		cons_putc(' ');
-		cons_putc(' ');
-		break;
-	default:
-		crt_buf[crt_pos++] = c;		/* write the character */
-		break;
 	}
+}
 
-	// What is the purpose of this?
-	if (crt_pos >= CRT_SIZE) {
-		int i;
-
-		memmove(crt_buf, crt_buf + CRT_COLS, (CRT_SIZE - CRT_COLS) * sizeof(uint16_t));
-		for (i = CRT_SIZE - CRT_COLS; i < CRT_SIZE; i++)
-			crt_buf[i] = 0x0700 | ' ';
-		crt_pos -= CRT_COLS;
+// Copy changed lines out to display memory, then move the screen
+// and the cursor.
+static void
+cga_flush(void)
+{
+	uint16_t *screen = crt_buf + crt_origin;
+	int row;
+
+	for (row = 0; crt_dirty; row++, crt_dirty >>= 1)
+		if (crt_dirty & 1)
+			memmove(screen + row * CRT_COLS, cga_line(row),
+				CRT_COLS * sizeof(uint16_t));
+
+	if (crt_start != crt_origin) {
+		outb(addr_6845, 12);
+		outb(addr_6845 + 1, crt_origin >> 8);
+		outb(addr_6845, 13);
+		outb(addr_6845 + 1, crt_origin);
+		crt_start = crt_origin;
 	}
 
 	/* move that little blinky thing */
-	outb(addr_6845, 14);
-	outb(addr_6845 + 1, crt_pos >> 8);
-	outb(addr_6845, 15);
-	outb(addr_6845 + 1, crt_pos);
+	if (crt_cursor != crt_origin + crt_pos) {
+		outb(addr_6845, 14);
+		outb(addr_6845 + 1, (crt_origin + crt_pos) >> 8);
+		outb(addr_6845, 15);
+		outb(addr_6845 + 1, crt_origin + crt_pos);
+		crt_cursor = crt_origin + crt_pos;
+	}
 }
 
 
@@ -354,6 +535,7 @@ kbd_proc_data(void)
 	// Ctrl-Alt-Del: reboot
 	if (!(~shift & (CTL | ALT)) && c == KEY_DEL) {
 		cprintf("Rebooting!\n");
+		klog_drain();
 		outb(0x92, 0x3); // courtesy of Chris Frost
 	}
 
@@ -424,22 +606,107 @@ cons_getc(void)
 	return 0;
 }
 
-// output a character to the console
+/***** Console output device table *****/
+// Every output device is probed once, at cons_init() time.
+// Only devices that are present and enabled are on the active list
+// that cons_write() and cons_flush() walk, so a missing or switched-off
+// device costs nothing per character.
+
+struct Consdev {
+	const char *name;
+	bool (*init)(void);	// probe and set up; return 1 if present
+	void (*write)(const char *buf, int len);
+	void (*flush)(void);	// make output visible (may be NULL)
+	bool present;
+	bool enabled;
+};
+
+static struct Consdev consdevs[] = {
+	{ "serial", serial_init, serial_write, NULL },
+	{ "lpt", lpt_init, lpt_write, NULL },
+	{ "cga", cga_init, cga_write, cga_flush },
+};
+#define NCONSDEV (sizeof(consdevs)/sizeof(consdevs[0]))
+
+static struct Consdev *cons_active[NCONSDEV];
+static int ncons_active;
+
 static void
-cons_putc(int c)
+cons_update_active(void)
 {
-	serial_putc(c);
-	lpt_putc(c);
-	cga_putc(c);
+	int i;
+
+	ncons_active = 0;
+	for (i = 0; i < NCONSDEV; i++)
+		if (consdevs[i].present && consdevs[i].enabled)
+			cons_active[ncons_active++] = &consdevs[i];
+}
+
+// Turn output to the device called 'name' on or off.
+int
+cons_enable(const char *name, bool on)
+{
+	int i;
+
+	for (i = 0; i < NCONSDEV; i++) {
+		if (strcmp(consdevs[i].name, name) != 0)
+			continue;
+		if (!consdevs[i].present)
+			return -E_INVAL;
+		// Don't leave anything stranded in a device we stop using
+		if (!on && consdevs[i].flush)
+			consdevs[i].flush();
+		consdevs[i].enabled = on;
+		cons_update_active();
+		return 0;
+	}
+	return -E_INVAL;
+}
+
+void
+cons_print_devices(void)
+{
+	int i;
+
+	for (i = 0; i < NCONSDEV; i++)
+		cprintf("  %-8s %s\n", consdevs[i].name,
+			!consdevs[i].present ? "not present"
+			: consdevs[i].enabled ? "on" : "off");
+}
+
+// output 'len' characters to the console, a device at a time, so
+// each device can handle the whole burst at once.
+// The display may not show them until the next cons_flush().
+void
+cons_write(const char *buf, int len)
+{
+	int i;
+
+	for (i = 0; i < ncons_active; i++)
+		cons_active[i]->write(buf, len);
+}
+
+// bring the display up to date with everything output so far
+void
+cons_flush(void)
+{
+	int i;
+
+	for (i = 0; i < ncons_active; i++)
+		if (cons_active[i]->flush)
+			cons_active[i]->flush();
 }
 
 // initialize the console devices
 void
 cons_init(void)
 {
-	cga_init();
+	int i;
+
 	kbd_init();
-	serial_init();
+	for (i = 0; i < NCONSDEV; i++)
+		consdevs[i].present = consdevs[i].enabled = consdevs[i].init();
+	cons_update_active();
 
 	if (!serial_exists)
 		cprintf("Serial port does not exist!\n");
@@ -451,7 +718,11 @@ cons_init(void)
 void
 cputchar(int c)
 {
-	cons_putc(c);
+	char ch = c;
+
+	// Go through the log, so as to stay in order with cprintf.
+	klog_write(&ch, 1);
+	klog_drain();
 }
 
 int
@@ -459,6 +730,8 @@ getchar(void)
 {
 	int c;
 
+	// About to wait for input: a good time to catch up on output.
+	klog_drain();
 	while ((c = cons_getc()) == 0)
 		/* do nothing */;
 	return c;
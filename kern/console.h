@@ -19,8 +19,15 @@
 
 void cons_init(void);
 int cons_getc(void);
+void cons_write(const char *buf, int len);
+void cons_flush(void);
+int cons_enable(const char *name, bool on);
+void cons_print_devices(void);
 
 void kbd_intr(void); // irq 1
 void serial_intr(void); // irq 4
 
+int serial_baud(void);
+int serial_set_baud(int baud);
+
 #endif /* _CONSOLE_H_ */
@@ -0,0 +1,47 @@
+// Floating point and SIMD setup.
+//
+// The kernel uses the SSE and AVX registers only in the string
+// routines (lib/string.c), and there is only one thread of control,
+// so their contents are never saved or restored.  Once there is
+// anything to switch between, its FPU state must be saved with it.
+
+#include <inc/mmu.h>
+#include <inc/x86.h>
+
+#include <kern/fpu.h>
+
+#define CPUID_FXSR	(1 << 24)	// CPUID.1:EDX
+#define CPUID_XSAVE	(1 << 26)	// CPUID.1:ECX
+#define CPUID_AVX	(1 << 28)	// CPUID.1:ECX
+
+#define XCR0_X87	0x1
+#define XCR0_SSE	0x2
+#define XCR0_AVX	0x4
+
+// Make the FPU, and SSE and AVX if the CPU has them, usable.
+void
+fpu_init(void)
+{
+	uint32_t ecx, edx, cr4;
+	uint64_t xcr0;
+
+	cpuid(1, NULL, NULL, &ecx, &edx);
+
+	// No emulation, and no device-not-available traps
+	lcr0((rcr0() & ~(CR0_EM | CR0_TS)) | CR0_MP);
+	__asm __volatile("fninit");
+
+	cr4 = rcr4();
+	if (edx & CPUID_FXSR)
+		cr4 |= CR4_OSFXSR | CR4_OSXMMEXCPT;
+	if (ecx & CPUID_XSAVE)
+		cr4 |= CR4_OSXSAVE;
+	lcr4(cr4);
+
+	if (ecx & CPUID_XSAVE) {
+		xcr0 = XCR0_X87 | XCR0_SSE;
+		if (ecx & CPUID_AVX)
+			xcr0 |= XCR0_AVX;
+		xsetbv(0, xcr0);
+	}
+}
@@ -3,9 +3,16 @@
 #include <inc/stdio.h>
 #include <inc/string.h>
 #include <inc/assert.h>
+#include <inc/memlayout.h>
+#include <inc/bootinfo.h>
 
 #include <kern/monitor.h>
 #include <kern/console.h>
+#include <kern/kdebug.h>
+#include <kern/boottrace.h>
+#include <kern/klog.h>
+#include <kern/ktrace.h>
+#include <kern/fpu.h>
 
 // Test the stack backtrace function (lab 1 only)
 void
@@ -23,20 +30,38 @@ void
 i386_init(void)
 {
 	extern char edata[], end[];
+	struct Bootinfo *bi = (struct Bootinfo *) (KERNBASE + BOOTINFO);
+	const char *kernels;
+
+	boottrace_init(bi);
 
 	// Before doing anything else, complete the ELF loading process.
 	// Clear the uninitialized global data (BSS) section of our program.
 	// This ensures that all static/global variables start out zero.
-	memset(edata, 0, end - edata);
+	// Our own boot loader zeroes BSS as it loads us, so skip the work
+	// if it says it has; other loaders (e.g., GRUB) leave no Bootinfo.
+	if (bi->bi_magic != BOOTINFO_MAGIC || !(bi->bi_flags & BI_BSS_CLEAR))
+		memset(edata, 0, end - edata);
+	// Don't let a stale Bootinfo fool us after the next reboot.
+	bi->bi_magic = 0;
+	boottrace("clear BSS");
+
+	// Turn on SSE and AVX, and let the string routines use them.
+	fpu_init();
+	kernels = string_init();
+	ktrace("string_init: %s kernels", kernels);
+	boottrace("fpu_init");
 
 	// Initialize the console.
 	// Can't call cprintf until after we do this!
 	cons_init();
+	boottrace("cons_init");
 
 	cprintf("6828 decimal is %o octal!\n", 6828);
 
 	// Test the stack backtrace function (lab 1 only)
 	test_backtrace(5);
+	boottrace("test_backtrace");
 
 	// Drop into the kernel monitor.
 	while (1)
@@ -71,6 +96,11 @@ _panic(const char *file, int line, const char *fmt,...)
 	vcprintf(fmt, ap);
 	cprintf("\n");
 	va_end(ap);
+	// Get the message out before anything else can go wrong.
+	klog_drain();
+	cprintf("Last trace records:\n");
+	ktrace_print(16);
+	klog_drain();
 
 dead:
 	/* break into the kernel monitor */
@@ -1,99 +1,300 @@
-#include <inc/stab.h>
 #include <inc/string.h>
 #include <inc/memlayout.h>
 #include <inc/assert.h>
+#include <inc/error.h>
 
 #include <kern/kdebug.h>
 
-extern const struct Stab __STAB_BEGIN__[];	// Beginning of stabs table
-extern const struct Stab __STAB_END__[];	// End of stabs table
-extern const char __STABSTR_BEGIN__[];		// Beginning of string table
-extern const char __STABSTR_END__[];		// End of string table
+// The kernel's symbol and line tables.  kern/mksyms.pl builds them from
+// the stabs when the kernel is linked, and they are loaded with the
+// kernel as the .ksyms section; see that script for the layout.
+extern const char __KSYMS_BEGIN__[];	// Beginning of .ksyms
+extern const char __KSYMS_END__[];	// End of .ksyms
+extern const char etext[];		// End of kernel code
 
+#define KSYMS_MAGIC	0x4D59534BU	/* "KSYM" in little endian */
+#define KSYM_NONAME	0xFFFFFFFFU
 
-// stab_binsearch(stabs, region_left, region_right, type, addr)
-//
-//	Some stab types are arranged in increasing order by instruction
-//	address.  For example, N_FUN stabs (stab entries with n_type ==
-//	N_FUN), which mark functions, and N_SO stabs, which mark source files.
-//
-//	Given an instruction address, this function finds the single stab
-//	entry of type 'type' that contains that address.
+struct Ksymhdr {
+	uint32_t magic;		// must equal KSYMS_MAGIC
+	uint32_t nfn;		// entries in the function table
+	uint32_t nfile;		// entries in the file table
+	uint32_t nhash;		// slots in the name hash table, a power of 2
+	uint32_t fn;		// offset of the function table
+	uint32_t file;		// offset of the file table
+	uint32_t hash;		// offset of the name hash table
+	uint32_t line;		// offset of the line programs
+	uint32_t str;		// offset of the string table
+};
+
+// A function, or an unnamed stretch of code outside any function.
+// Unnamed regions with no lines are gaps between source files.
+struct Ksymfn {
+	uint32_t addr;		// start address
+	uint32_t name;		// string table offset, or KSYM_NONAME
+	uint32_t lines;		// offset of this region's line program
+	uint16_t nline;		// entries in the line program
+	uint16_t narg;		// number of parameters
+};
+
+// Return the symbol table header, or NULL if the tables look broken.
+static const struct Ksymhdr *
+ksyms(void)
+{
+	const struct Ksymhdr *h = (const struct Ksymhdr *) __KSYMS_BEGIN__;
+	uint32_t size = __KSYMS_END__ - __KSYMS_BEGIN__;
+
+	if (size < sizeof(*h) || h->magic != KSYMS_MAGIC
+	    || h->fn + h->nfn * sizeof(struct Ksymfn) > h->file
+	    || h->file + h->nfile * sizeof(uint32_t) > h->hash
+	    || h->nhash == 0 || (h->nhash & (h->nhash - 1))
+	    || h->hash + h->nhash * sizeof(uint32_t) > h->line
+	    || h->line > h->str || h->str >= size
+	    || __KSYMS_END__[-1] != 0)
+		return NULL;
+	return h;
+}
+
+// Find the region containing 'addr': the last one starting at or
+// before it.  Returns NULL if 'addr' precedes them all.
+static const struct Ksymfn *
+ksym_region(const struct Ksymhdr *h, uintptr_t addr)
+{
+	const struct Ksymfn *fn = (const struct Ksymfn *) (__KSYMS_BEGIN__ + h->fn);
+	int l = 0, r = h->nfn, m;
+
+	// Invariant: fn[l - 1].addr <= addr < fn[r].addr
+	while (l < r) {
+		m = (l + r) / 2;
+		if (fn[m].addr <= addr)
+			l = m + 1;
+		else
+			r = m;
+	}
+	return l > 0 ? &fn[l - 1] : NULL;
+}
+
+static uint32_t
+uleb128(const uint8_t **p)
+{
+	uint32_t v = 0;
+	int shift = 0;
+	uint8_t b;
+
+	do {
+		b = *(*p)++;
+		v |= (uint32_t) (b & 0x7F) << shift;
+		shift += 7;
+	} while (b & 0x80);
+	return v;
+}
+
+static int32_t
+sleb128(const uint8_t **p)
+{
+	uint32_t v = 0;
+	int shift = 0;
+	uint8_t b;
+
+	do {
+		b = *(*p)++;
+		v |= (uint32_t) (b & 0x7F) << shift;
+		shift += 7;
+	} while (b & 0x80);
+	if (shift < 32 && (b & 0x40))
+		v |= ~0U << shift;
+	return v;
+}
+
+// Decoding state for a region's line program
+struct Lineprog {
+	const struct Ksymhdr *h;
+	const uint8_t *p;
+	int left;		// entries not yet decoded
+	uint32_t addr;		// the current entry's address,
+	uint32_t file;		// file table index
+	int line;		// and line number
+};
+
+static void
+lineprog_start(struct Lineprog *lp, const struct Ksymhdr *h,
+	       const struct Ksymfn *fn)
+{
+	lp->h = h;
+	lp->p = (const uint8_t *) __KSYMS_BEGIN__ + h->line + fn->lines;
+	lp->left = fn->nline;
+	lp->addr = fn->addr;
+	lp->file = 0;
+	lp->line = 0;
+}
+
+// Step to the next entry.  Returns 0 if there are no more.
+static int
+lineprog_next(struct Lineprog *lp)
+{
+	uint32_t v;
+
+	if (lp->left == 0)
+		return 0;
+	lp->left--;
+	v = uleb128(&lp->p);
+	lp->addr += v >> 1;
+	if (v & 1)
+		lp->file = uleb128(&lp->p);
+	lp->line += sleb128(&lp->p);
+	return 1;
+}
+
+// The current entry's file name
+static const char *
+lineprog_file(const struct Lineprog *lp)
+{
+	const uint32_t *files = (const uint32_t *) (__KSYMS_BEGIN__ + lp->h->file);
+
+	if (lp->file >= lp->h->nfile)
+		return "<unknown>";
+	return __KSYMS_BEGIN__ + lp->h->str + files[lp->file];
+}
+
+// Look 'addr' up in the symbol tables; see debuginfo_eip().
+static int
+ksym_debuginfo(uintptr_t addr, struct Eipdebuginfo *info)
+{
+	const struct Ksymhdr *h;
+	const struct Ksymfn *fn;
+	struct Lineprog lp;
+	int found = 0;
+
+	if ((h = ksyms()) == NULL)
+		return -1;
+
+	// Find the function containing 'addr'.  If it's in code outside
+	// any function (an assembly file, say), we can still find the
+	// line number.
+	if ((fn = ksym_region(h, addr)) == NULL)
+		return -1;
+	if (fn->name != KSYM_NONAME) {
+		info->eip_fn_name = __KSYMS_BEGIN__ + h->str + fn->name;
+		info->eip_fn_namelen = strlen(info->eip_fn_name);
+		info->eip_fn_addr = fn->addr;
+		info->eip_fn_narg = fn->narg;
+	}
+
+	// Run the region's line program up to 'addr'.
+	lineprog_start(&lp, h, fn);
+	while (lineprog_next(&lp) && lp.addr <= addr) {
+		info->eip_line = lp.line;
+		info->eip_file = lineprog_file(&lp);
+		found = 1;
+	}
+	return found ? 0 : -1;
+}
+
+
+// Looking functions up by name.
 //
-//	The search takes place within the range [*region_left, *region_right].
-//	Thus, to search an entire set of N stabs, you might do:
+//	kern/mksyms.pl hashes the names in the function table into a
+//	table sized to fit them, using open addressing with linear
+//	probing, so that debuginfo_fn() need not look through the
+//	whole function table.
+
+static uint32_t
+hash_name(const char *s)
+{
+	uint32_t h = 2166136261U;	// FNV-1a, as fnv1a() in mksyms.pl
+
+	while (*s)
+		h = (h ^ (uint8_t) *s++) * 16777619U;
+	return h;
+}
+
+// Return the function table entry for the function called 'name'.
+// If there are several (static functions in different files), returns
+// the one at the lowest address.
+static const struct Ksymfn *
+ksym_byname(const struct Ksymhdr *h, const char *name)
+{
+	const struct Ksymfn *fn = (const struct Ksymfn *) (__KSYMS_BEGIN__ + h->fn);
+	const uint32_t *hash = (const uint32_t *) (__KSYMS_BEGIN__ + h->hash);
+	const char *str = __KSYMS_BEGIN__ + h->str;
+	uint32_t i, slot;
+
+	for (slot = hash_name(name); (i = hash[slot % h->nhash]) != 0; slot++)
+		if (i <= h->nfn && strcmp(str + fn[i - 1].name, name) == 0)
+			return &fn[i - 1];
+	return NULL;
+}
+
+// debuginfo_fn(name, info)
 //
-//		left = 0;
-//		right = N - 1;     /* rightmost stab */
-//		stab_binsearch(stabs, &left, &right, type, addr);
+//	Fill in the 'info' structure with information about the function
+//	called 'name'.  Returns 0 if it was found, and negative if not.
 //
-//	The search modifies *region_left and *region_right to bracket the
-//	'addr'.  *region_left points to the matching stab that contains
-//	'addr', and *region_right points just before the next stab.  If
-//	*region_left > *region_right, then 'addr' is not contained in any
-//	matching stab.
+int
+debuginfo_fn(const char *name, struct Fndebuginfo *info)
+{
+	const struct Ksymhdr *h;
+	const struct Ksymfn *fn;
+	struct Lineprog lp;
+
+	if ((h = ksyms()) == NULL || (fn = ksym_byname(h, name)) == NULL)
+		return -E_INVAL;
+
+	info->fn_name = __KSYMS_BEGIN__ + h->str + fn->name;
+	info->fn_start = fn->addr;
+	// It ends where the next function, or the gap after its file,
+	// begins.  That includes any padding after it.
+	if (fn + 1 < (const struct Ksymfn *) (__KSYMS_BEGIN__ + h->fn) + h->nfn)
+		info->fn_end = fn[1].addr;
+	else
+		info->fn_end = (uintptr_t) etext;
+	info->fn_narg = fn->narg;
+	info->fn_file = "<unknown>";
+	info->fn_line = 0;
+	lineprog_start(&lp, h, fn);
+	if (lineprog_next(&lp)) {
+		info->fn_file = lineprog_file(&lp);
+		info->fn_line = lp.line;
+	}
+	return 0;
+}
+
+// debuginfo_fn_lines(info, func, arg)
 //
-//	For example, given these N_SO stabs:
-//		Index  Type   Address
-//		0      SO     f0100000
-//		13     SO     f0100040
-//		117    SO     f0100176
-//		118    SO     f0100178
-//		555    SO     f0100652
-//		556    SO     f0100654
-//		657    SO     f0100849
-//	this code:
-//		left = 0, right = 657;
-//		stab_binsearch(stabs, &left, &right, N_SO, 0xf0100184);
-//	will exit setting left = 118, right = 554.
+//	Call func(addr, file, line, arg) for each line table entry of the
+//	function that 'info' describes, in address order.
 //
-static void
-stab_binsearch(const struct Stab *stabs, int *region_left, int *region_right,
-	       int type, uintptr_t addr)
+void
+debuginfo_fn_lines(const struct Fndebuginfo *info,
+		   void (*func)(uintptr_t, const char *, int, void *), void *arg)
 {
-	int l = *region_left, r = *region_right, any_matches = 0;
-
-	while (l <= r) {
-		int true_m = (l + r) / 2, m = true_m;
-
-		// search for earliest stab with right type
-		while (m >= l && stabs[m].n_type != type)
-			m--;
-		if (m < l) {	// no match in [l, m]
-			l = true_m + 1;
-			continue;
-		}
-
-		// actual binary search
-		any_matches = 1;
-		if (stabs[m].n_value < addr) {
-			*region_left = m;
-			l = true_m + 1;
-		} else if (stabs[m].n_value > addr) {
-			*region_right = m - 1;
-			r = m - 1;
-		} else {
-			// exact match for 'addr', but continue loop to find
-			// *region_right
-			*region_left = m;
-			l = m;
-			addr++;
-		}
-	}
+	const struct Ksymhdr *h;
+	const struct Ksymfn *fn;
+	struct Lineprog lp;
 
-	if (!any_matches)
-		*region_right = *region_left - 1;
-	else {
-		// find rightmost region containing 'addr'
-		for (l = *region_right;
-		     l > *region_left && stabs[l].n_type != type;
-		     l--)
-			/* do nothing */;
-		*region_left = l;
-	}
+	if ((h = ksyms()) == NULL
+	    || (fn = ksym_region(h, info->fn_start)) == NULL)
+		return;
+	lineprog_start(&lp, h, fn);
+	while (lineprog_next(&lp))
+		func(lp.addr, lineprog_file(&lp), lp.line, arg);
 }
 
 
+// The same few return addresses show up in backtrace after backtrace,
+// so remember recent lookups in a small direct-mapped cache.
+#define EIPCACHE_SHIFT	6
+#define NEIPCACHE	(1 << EIPCACHE_SHIFT)
+
+static struct Eipcache {
+	uintptr_t eip;		// 0 if the entry is empty
+	int r;			// what ksym_debuginfo() returned
+	struct Eipdebuginfo info;
+} eipcache[NEIPCACHE];
+
+static uint32_t eipcache_hits, eipcache_misses;
+
+
 // debuginfo_eip(addr, info)
 //
 //	Fill in the 'info' structure with information about the specified
@@ -104,9 +305,7 @@ stab_binsearch(const struct Stab *stabs, int *region_left, int *region_right,
 int
 debuginfo_eip(uintptr_t addr, struct Eipdebuginfo *info)
 {
-	const struct Stab *stabs, *stab_end;
-	const char *stabstr, *stabstr_end;
-	int lfile, rfile, lfun, rfun, lline, rline;
+	struct Eipcache *c;
 
 	// Initialize *info
 	info->eip_file = "<unknown>";
@@ -116,95 +315,36 @@ debuginfo_eip(uintptr_t addr, struct Eipdebuginfo *info)
 	info->eip_fn_addr = addr;
 	info->eip_fn_narg = 0;
 
-	// Find the relevant set of stabs
-	if (addr >= ULIM) {
-		stabs = __STAB_BEGIN__;
-		stab_end = __STAB_END__;
-		stabstr = __STABSTR_BEGIN__;
-		stabstr_end = __STABSTR_END__;
-	} else {
-		// Can't search for user-level addresses yet!
-  	        panic("User address");
-	}
-
-	// String table validity checks
-	if (stabstr_end <= stabstr || stabstr_end[-1] != 0)
-		return -1;
-
-	// Now we find the right stabs that define the function containing
-	// 'eip'.  First, we find the basic source file containing 'eip'.
-	// Then, we look in that source file for the function.  Then we look
-	// for the line number.
+	// Can't search for user-level addresses yet!
+	if (addr < ULIM)
+		panic("User address");
 
-	// Search the entire set of stabs for the source file (type N_SO).
-	lfile = 0;
-	rfile = (stab_end - stabs) - 1;
-	stab_binsearch(stabs, &lfile, &rfile, N_SO, addr);
-	if (lfile == 0)
-		return -1;
-
-	// Search within that file's stabs for the function definition
-	// (N_FUN).
-	lfun = lfile;
-	rfun = rfile;
-	stab_binsearch(stabs, &lfun, &rfun, N_FUN, addr);
-
-	if (lfun <= rfun) {
-		// stabs[lfun] points to the function name
-		// in the string table, but check bounds just in case.
-		if (stabs[lfun].n_strx < stabstr_end - stabstr)
-			info->eip_fn_name = stabstr + stabs[lfun].n_strx;
-		info->eip_fn_addr = stabs[lfun].n_value;
-		addr -= info->eip_fn_addr;
-		// Search within the function definition for the line number.
-		lline = lfun;
-		rline = rfun;
-	} else {
-		// Couldn't find function stab!  Maybe we're in an assembly
-		// file.  Search the whole file for the line number.
-		info->eip_fn_addr = addr;
-		lline = lfile;
-		rline = rfile;
+	// Fibonacci hashing spreads nearby addresses over the cache
+	c = &eipcache[(addr * 0x9E3779B1U) >> (32 - EIPCACHE_SHIFT)];
+	if (c->eip == addr) {
+		eipcache_hits++;
+		*info = c->info;
+		return c->r;
 	}
-	// Ignore stuff after the colon.
-	info->eip_fn_namelen = strfind(info->eip_fn_name, ':') - info->eip_fn_name;
-
-
-	// Search within [lline, rline] for the line number stab.
-	// If found, set info->eip_line to the right line number.
-	// If not found, return -1.
-	//
-	// Hint:
-	//	There's a particular stabs type used for line numbers.
-	//	Look at the STABS documentation and <inc/stab.h> to find
-	//	which one.
-  stab_binsearch(stabs, &lline, &rline, N_SLINE, addr);
-  if (lline <= rline) {
-    info->eip_line = stabs[lline].n_desc;
-  } else {
-    return -1;
-  }
-
-	// Search backwards from the line number for the relevant filename
-	// stab.
-	// We can't just use the "lfile" stab because inlined functions
-	// can interpolate code from a different file!
-	// Such included source files use the N_SOL stab type.
-	while (lline >= lfile
-	       && stabs[lline].n_type != N_SOL
-	       && (stabs[lline].n_type != N_SO || !stabs[lline].n_value))
-		lline--;
-	if (lline >= lfile && stabs[lline].n_strx < stabstr_end - stabstr)
-		info->eip_file = stabstr + stabs[lline].n_strx;
-
-
-	// Set eip_fn_narg to the number of arguments taken by the function,
-	// or 0 if there was no containing function.
-	if (lfun < rfun)
-		for (lline = lfun + 1;
-		     lline < rfun && stabs[lline].n_type == N_PSYM;
-		     lline++)
-			info->eip_fn_narg++;
+	eipcache_misses++;
+	c->r = ksym_debuginfo(addr, info);
+	c->info = *info;
+	c->eip = addr;
+	return c->r;
+}
 
-	return 0;
+// Report how well the debuginfo_eip() cache is doing.
+void
+debuginfo_cache_stats(uint32_t *hits, uint32_t *misses)
+{
+	*hits = eipcache_hits;
+	*misses = eipcache_misses;
+}
+
+// Empty the debuginfo_eip() cache and zero its counters.
+void
+debuginfo_cache_reset(void)
+{
+	memset(eipcache, 0, sizeof(eipcache));
+	eipcache_hits = eipcache_misses = 0;
 }
@@ -15,6 +15,23 @@ struct Eipdebuginfo {
 	int eip_fn_narg;		// Number of function arguments
 };
 
+// Debug information about a function, looked up by name
+struct Fndebuginfo {
+	const char *fn_name;		// Name of the function
+	uintptr_t fn_start;		// Address of its first instruction
+	uintptr_t fn_end;		// Address just past it
+	const char *fn_file;		// Source code filename of its start
+	int fn_line;			// Source code linenumber of its start
+	int fn_narg;			// Number of function arguments
+};
+
 int debuginfo_eip(uintptr_t eip, struct Eipdebuginfo *info);
+int debuginfo_fn(const char *name, struct Fndebuginfo *info);
+void debuginfo_fn_lines(const struct Fndebuginfo *info,
+			void (*func)(uintptr_t addr, const char *file,
+				     int line, void *arg),
+			void *arg);
+void debuginfo_cache_stats(uint32_t *hits, uint32_t *misses);
+void debuginfo_cache_reset(void);
 
 #endif
@@ -0,0 +1,121 @@
+// The kernel log.
+//
+// All console output is appended to a ring buffer in memory, and only
+// copied out to the (slow) console devices later, by klog_drain().
+// A writer reserves space with a single atomic add on the write
+// position, copies its bytes in, and then adds its length to the
+// commit count.  When the two are equal no write is in progress, and
+// everything up to the write position is ready to drain.
+//
+// Writers never wait for the drain.  If the log fills up, the oldest
+// undrained bytes are overwritten, and the drain reports the loss.
+
+#include <inc/stdio.h>
+#include <inc/string.h>
+#include <inc/assert.h>
+#include <inc/x86.h>
+
+#include <kern/klog.h>
+#include <kern/console.h>
+#include <kern/ktrace.h>
+
+// Size of the log in bytes; must be a power of 2.
+#ifndef KLOG_SIZE
+#define KLOG_SIZE	262144
+#endif
+
+extern const char *panicstr;
+
+// Positions count bytes since boot; buf is indexed modulo KLOG_SIZE.
+static struct {
+	volatile uint32_t wpos;		// end of the last reserved write
+	volatile uint32_t committed;	// bytes whose writes are complete
+	uint32_t rpos;			// next byte to drain
+	volatile uint32_t draining;	// klog_drain() is running
+	char buf[KLOG_SIZE];
+} klog;
+
+// Append 'len' bytes to the log.  Does no device I/O.
+void
+klog_write(const char *buf, int len)
+{
+	uint32_t pos, off, n;
+
+	static_assert((KLOG_SIZE & (KLOG_SIZE - 1)) == 0);
+
+	if (len <= 0)
+		return;
+	// Only the tail of an enormous write could survive anyway.
+	if (len > KLOG_SIZE) {
+		buf += len - KLOG_SIZE;
+		len = KLOG_SIZE;
+	}
+
+	pos = xadd(&klog.wpos, len);
+	off = pos % KLOG_SIZE;
+	n = MIN((uint32_t) len, KLOG_SIZE - off);
+	memmove(klog.buf + off, buf, n);
+	memmove(klog.buf, buf + n, len - n);
+	xadd(&klog.committed, len);
+}
+
+// Send the log between positions 'from' and 'to' to the console.
+static void
+klog_emit(uint32_t from, uint32_t to)
+{
+	uint32_t off, n;
+
+	while (from != to) {
+		off = from % KLOG_SIZE;
+		n = MIN(to - from, KLOG_SIZE - off);
+		cons_write(klog.buf + off, n);
+		from += n;
+	}
+}
+
+// Push everything logged since the last drain out to the console.
+void
+klog_drain(void)
+{
+	uint32_t c, w, lost;
+	char note[40];
+
+	// Only one drain at a time, unless we've panicked: then the
+	// output has to get out no matter what.
+	if (xchg(&klog.draining, 1) && !panicstr)
+		return;
+
+	// Read 'committed' first: if it then equals 'wpos',
+	// every write reserved so far is complete.
+	c = klog.committed;
+	w = klog.wpos;
+	if (c != w)
+		goto out;	// the next drain will pick it up
+
+	if (w - klog.rpos > KLOG_SIZE) {
+		lost = w - klog.rpos - KLOG_SIZE;
+		klog.rpos = w - KLOG_SIZE;
+		cons_write(note, snprintf(note, sizeof(note),
+					  "[klog: %u bytes lost]\n", lost));
+		ktrace("klog: %u bytes lost", lost);
+	}
+	klog_emit(klog.rpos, w);
+	klog.rpos = w;
+	cons_flush();
+
+out:
+	klog.draining = 0;
+}
+
+// Show everything the log still holds, including what has already
+// been drained.
+void
+klog_dump(void)
+{
+	uint32_t w;
+
+	klog_drain();
+	w = klog.wpos;
+	klog_emit(w - MIN(w, (uint32_t) KLOG_SIZE), w);
+	cons_flush();
+}
@@ -0,0 +1,15 @@
+#ifndef JOS_KERN_KLOG_H
+#define JOS_KERN_KLOG_H
+#ifndef JOS_KERNEL
+# error "This is a JOS kernel header; user programs should not #include it"
+#endif
+
+// The kernel log: an in-memory ring that holds all console output.
+// klog_write() only copies into memory; klog_drain() pushes whatever
+// has not been shown yet out to the console devices.  The kernel
+// drains the log when it is about to wait for input, and on panic.
+void klog_write(const char *buf, int len);
+void klog_drain(void);
+void klog_dump(void);
+
+#endif	// !JOS_KERN_KLOG_H
@@ -0,0 +1,90 @@
+// Binary trace records with deferred formatting.
+//
+// _ktrace() does no formatting at all: it claims a slot in the ring
+// with one atomic add, and fills in the format pointer, the TSC and
+// the raw argument words.  ktrace_print() hands each record to
+// vsnprintf() later, with the saved words standing in for the
+// caller's arguments, and logs each record as a single line.
+
+#include <inc/stdio.h>
+#include <inc/stdarg.h>
+#include <inc/assert.h>
+#include <inc/x86.h>
+
+#include <kern/ktrace.h>
+#include <kern/klog.h>
+#include <kern/tsc.h>
+
+#define NKTRACE		1024	// records kept; must be a power of 2
+
+struct Ktrace {
+	const char *fmt;	// NULL while the record is being written
+	uint32_t args[KTRACE_MAXARGS];
+	uint64_t tsc;
+};
+
+static struct {
+	volatile uint32_t next;		// records ever started
+	struct Ktrace rec[NKTRACE];
+} ktr;
+
+void
+_ktrace(int nargs, const char *fmt, ...)
+{
+	struct Ktrace *r;
+	va_list ap;
+	int i;
+
+	static_assert((NKTRACE & (NKTRACE - 1)) == 0);
+
+	r = &ktr.rec[xadd(&ktr.next, 1) % NKTRACE];
+	r->fmt = NULL;
+	r->tsc = read_tsc();
+	va_start(ap, fmt);
+	for (i = 0; i < nargs; i++)
+		r->args[i] = va_arg(ap, uint32_t);
+	va_end(ap);
+	// Publish the record only once it is complete
+	asm volatile("" : : : "memory");
+	r->fmt = fmt;
+}
+
+// Print the last 'n' trace records (all of them if n <= 0), oldest first.
+void
+ktrace_print(int n)
+{
+	uint32_t next, i;
+	uint64_t start, prev;
+	struct Ktrace *r;
+	va_list ap;
+	char line[160];
+	int len;
+
+	next = ktr.next;
+	if (n <= 0 || n > NKTRACE)
+		n = NKTRACE;
+	if ((uint32_t) n > next)
+		n = next;
+	if (n == 0) {
+		cprintf("No trace records\n");
+		return;
+	}
+
+	start = prev = ktr.rec[(next - n) % NKTRACE].tsc;
+	cprintf("  %10s %10s  %s\n", "us", "cycles", "event");
+	for (i = next - n; i != next; i++) {
+		r = &ktr.rec[i % NKTRACE];
+		if (r->fmt == NULL)
+			continue;
+		len = snprintf(line, sizeof(line), "  %10llu %10llu  ",
+			       tsc_to_us(r->tsc - start), r->tsc - prev);
+		// On the i386 a va_list is just a pointer to the argument
+		// words, so the saved words can be formatted in place.
+		ap = (va_list) r->args;
+		len += vsnprintf(line + len, sizeof(line) - len - 1, r->fmt, ap);
+		len = MIN(len, (int) sizeof(line) - 2);
+		line[len++] = '\n';
+		klog_write(line, len);
+		prev = r->tsc;
+	}
+}
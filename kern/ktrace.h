@@ -0,0 +1,33 @@
+#ifndef JOS_KERN_KTRACE_H
+#define JOS_KERN_KTRACE_H
+#ifndef JOS_KERNEL
+# error "This is a JOS kernel header; user programs should not #include it"
+#endif
+
+// Cheap tracing for code that can't afford cprintf.
+// ktrace(fmt, ...) stores only 'fmt', a TSC stamp, and up to
+// KTRACE_MAXARGS arguments in a ring of binary records; the format
+// string is not looked at until the records are printed.  So 'fmt'
+// must be a string constant, and every argument must fit in 32 bits
+// (ints, unsigneds, pointers, strings that will still exist later).
+// Trace messages should not end in a newline.
+#define KTRACE_MAXARGS	6
+
+#define ktrace(...) \
+	_ktrace(KTRACE_CHECK(KTRACE_NARGS(__VA_ARGS__, 15, 14, 13, 12, 11, \
+					  10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0)), \
+		__VA_ARGS__)
+#define KTRACE_NARGS(fmt, a1, a2, a3, a4, a5, a6, a7, a8, a9, a10, \
+		     a11, a12, a13, a14, a15, n, ...) n
+
+// Evaluates to 'n', but doesn't compile unless 'n' is a constant no
+// bigger than KTRACE_MAXARGS, so a ktrace() with too many arguments
+// is caught at build time.
+#define KTRACE_CHECK(n) \
+	((int) ((n) + 0 * sizeof(struct { \
+		int too_many_ktrace_args : (n) <= KTRACE_MAXARGS ? 1 : -1; })))
+
+void _ktrace(int nargs, const char *fmt, ...);
+void ktrace_print(int n);
+
+#endif	// !JOS_KERN_KTRACE_H
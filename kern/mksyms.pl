@@ -0,0 +1,222 @@
+#!/usr/bin/perl
+#
+# mksyms.pl: build the kernel's .ksyms section from its stabs.
+#
+# Usage: mksyms.pl kernel ksyms.bin
+#
+# The kernel is linked twice.  The first link has an empty .ksyms
+# section; this script reads that kernel's .stab and .stabstr and
+# writes the tables that debuginfo_eip() (kern/kdebug.c) searches.
+# The second link adds them as .ksyms, which comes after .text and
+# .rodata, so no code moves.
+#
+# Layout (all little-endian; offsets are from the start of the section):
+#
+#	struct Ksymhdr			// see kern/kdebug.c
+#	struct Ksymfn fn[nfn]		// sorted by address
+#	uint32_t file[nfile]		// file names, as string offsets
+#	uint32_t hash[nhash]		// function names, hashed
+#	uint8_t line[]			// line programs, one per function
+#	char str[]			// NUL-terminated strings
+#
+# The function table divides the kernel text into regions.  Each is
+# either a function, or (with no name) a stretch of a source file
+# outside any function, or (no name, no lines) a gap between files.
+#
+# A region's line program holds its N_SLINE entries in address order.
+# Each entry is a ULEB128 (address delta * 2 + new file), optionally a
+# ULEB128 file table index if the "new file" bit is set, and an SLEB128
+# line delta.  Deltas are from the previous entry.  The first entry
+# starts from the region's address and line 0, and always sets the file.
+#
+# The hash table finds named functions by name.  It is open-addressed
+# with linear probing on the FNV-1a hash of the name; each slot holds a
+# function table index + 1, or 0 if empty.  nhash is a power of 2 at
+# least twice the number of names, so probe runs stay short.  Names
+# are inserted in address order, so of several functions with the same
+# name (static functions in different files) the lowest comes first.
+
+use strict;
+
+my $MAGIC = 0x4D59534B;		# "KSYM"
+my $NONAME = 0xFFFFFFFF;
+
+my ($N_FUN, $N_SLINE, $N_SO, $N_SOL, $N_PSYM) = (0x24, 0x44, 0x64, 0x84, 0xa0);
+
+open(IN, $ARGV[0]) || die "open $ARGV[0]: $!";
+binmode IN;
+my $elf;
+{ local $/; $elf = <IN>; }
+close IN;
+
+die "$ARGV[0]: not an ELF file\n" if substr($elf, 0, 4) ne "\x7FELF";
+
+# Find the stab sections.
+my ($shoff) = unpack("V", substr($elf, 32, 4));
+my ($shentsize, $shnum, $shstrndx) = unpack("vvv", substr($elf, 46, 6));
+my @sh;
+for (my $i = 0; $i < $shnum; $i++) {
+	push @sh, [unpack("V10", substr($elf, $shoff + $i * $shentsize, 40))];
+}
+my %sect;
+for my $s (@sh) {
+	my $name = unpack("Z*", substr($elf, $sh[$shstrndx][4] + $s->[0]));
+	$sect{$name} = substr($elf, $s->[4], $s->[5]);
+}
+die "$ARGV[0]: no stabs\n" unless defined($sect{".stab"}) && defined($sect{".stabstr"});
+my $stab = $sect{".stab"};
+my $stabstr = $sect{".stabstr"};
+
+# Strings, interned
+my $str = "";
+my %stroff;
+sub intern {
+	my ($s) = @_;
+	if (!defined($stroff{$s})) {
+		$stroff{$s} = length($str);
+		$str .= "$s\0";
+	}
+	return $stroff{$s};
+}
+
+# File names, interned
+my @files;
+my %fileidx;
+sub file {
+	my ($s) = @_;
+	if (!defined($fileidx{$s})) {
+		$fileidx{$s} = scalar(@files);
+		push @files, intern($s);
+	}
+	return $fileidx{$s};
+}
+
+# Walk the stabs, collecting regions and lines.
+my @regions;		# [addr, name, narg]
+my @lines;		# [addr, line, file]
+my ($fn, $base, $file);
+for (my $off = 0; $off + 12 <= length($stab); $off += 12) {
+	my ($strx, $type, $other, $desc, $value) =
+	    unpack("VCCvV", substr($stab, $off, 12));
+	my $name = unpack("Z*", substr($stabstr, $strx));
+	if ($type == $N_SO) {
+		# A named N_SO starts a file; an empty one ends it.
+		push @regions, [$value, $NONAME, 0];
+		$fn = undef;
+		$base = 0;
+		$file = file($name) if $name ne "";
+	} elsif ($type == $N_SOL) {
+		$file = file($name) if $name ne "";
+	} elsif ($type == $N_FUN && $name ne "") {
+		$name =~ s/:.*//;
+		$fn = [$value, intern($name), 0];
+		push @regions, $fn;
+		$base = $value;
+	} elsif ($type == $N_PSYM && defined($fn)) {
+		$fn->[2]++;
+	} elsif ($type == $N_SLINE && defined($file)) {
+		push @lines, [$base + $value, $desc, $file];
+	}
+}
+
+# Perl's sort is stable, so of several entries at the same address
+# the last one found in the stabs wins, as it should.
+@regions = sort { $a->[0] <=> $b->[0] } @regions;
+@lines = sort { $a->[0] <=> $b->[0] } @lines;
+
+sub uleb {
+	my ($n) = @_;
+	my $s = "";
+	while ($n >= 0x80) {
+		$s .= chr(($n & 0x7F) | 0x80);
+		$n >>= 7;
+	}
+	return $s . chr($n);
+}
+
+sub sleb {
+	use integer;		# so >> is an arithmetic shift
+	my ($n) = @_;
+	my $s = "";
+	while (1) {
+		my $b = $n & 0x7F;
+		$n >>= 7;
+		if (($n == 0 && !($b & 0x40)) || ($n == -1 && ($b & 0x40))) {
+			return $s . chr($b);
+		}
+		$s .= chr($b | 0x80);
+	}
+}
+
+# Give each region the lines between its address and the next region's,
+# and encode them.
+my $fntab = "";
+my $linetab = "";
+my $nfn = 0;
+my $l = 0;
+for (my $i = 0; $i < @regions; $i++) {
+	my ($addr, $name, $narg) = @{$regions[$i]};
+	my $end = $i + 1 < @regions ? $regions[$i + 1][0] : 0xFFFFFFFF;
+	$l++ while $l < @lines && $lines[$l][0] < $addr;
+	my $prog = "";
+	my ($paddr, $pline, $pfile, $n) = ($addr, 0, -1, 0);
+	for (; $l < @lines && $lines[$l][0] < $end; $l++, $n++) {
+		my ($laddr, $line, $lfile) = @{$lines[$l]};
+		my $newfile = $lfile != $pfile;
+		$prog .= uleb(($laddr - $paddr) * 2 + $newfile);
+		$prog .= uleb($lfile) if $newfile;
+		$prog .= sleb($line - $pline);
+		($paddr, $pline, $pfile) = ($laddr, $line, $lfile);
+	}
+	# Drop unnamed regions without lines that start where the
+	# next region does; they cover nothing.
+	next if $name == $NONAME && $n == 0 && $end == $addr;
+	die "$ARGV[0]: too many lines in one function\n" if $n > 0xFFFF;
+	$fntab .= pack("VVVvv", $addr, $name, length($linetab), $n, $narg);
+	$linetab .= $prog;
+	$nfn++;
+}
+
+sub fnv1a {
+	my ($s) = @_;
+	my $h = 2166136261;
+	for my $c (unpack("C*", $s)) {
+		$h = (($h ^ $c) * 16777619) & 0xFFFFFFFF;
+	}
+	return $h;
+}
+
+# Hash the names in the function table as it was written out.
+my @hash;
+{
+	my @named;
+	for (my $i = 0; $i < $nfn; $i++) {
+		my ($name) = unpack("V", substr($fntab, $i * 16 + 4, 4));
+		push @named, [$i, $name] if $name != $NONAME;
+	}
+	my $nhash = 1;
+	$nhash *= 2 while $nhash < 2 * @named;
+	@hash = (0) x $nhash;
+	for my $f (@named) {
+		my ($i, $name) = @$f;
+		my $slot = fnv1a(unpack("Z*", substr($str, $name)));
+		$slot++ while $hash[$slot % $nhash];
+		$hash[$slot % $nhash] = $i + 1;
+	}
+}
+
+my $filetab = pack("V*", @files);
+my $hashtab = pack("V*", @hash);
+my $hdrsize = 36;
+my $fnoff = $hdrsize;
+my $fileoff = $fnoff + length($fntab);
+my $hashoff = $fileoff + length($filetab);
+my $lineoff = $hashoff + length($hashtab);
+my $stroff = $lineoff + length($linetab);
+
+open(OUT, ">$ARGV[1]") || die "open >$ARGV[1]: $!";
+binmode OUT;
+print OUT pack("V9", $MAGIC, $nfn, scalar(@files), scalar(@hash),
+	       $fnoff, $fileoff, $hashoff, $lineoff, $stroff);
+print OUT $fntab, $filetab, $hashtab, $linetab, $str;
+close OUT;
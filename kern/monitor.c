@@ -10,6 +10,12 @@
 #include <kern/console.h>
 #include <kern/monitor.h>
 #include <kern/kdebug.h>
+#include <kern/boottrace.h>
+#include <kern/klog.h>
+#include <kern/ktrace.h>
+#include <kern/profile.h>
+#include <kern/perf.h>
+#include <kern/strcheck.h>
 
 #define CMDBUF_SIZE	80	// enough for one VGA text line
 
@@ -25,6 +31,18 @@ static struct Command commands[] = {
 	{ "help", "Display this list of commands", mon_help },
 	{ "kerninfo", "Display information about the kernel", mon_kerninfo },
   { "backtrace", "Show the backtrace", mon_backtrace },
+	{ "boottime", "Show how long each boot phase took", mon_boottime },
+	{ "baud", "Show or set the serial console speed", mon_baud },
+	{ "cons", "List console devices, or turn one on or off", mon_cons },
+	{ "dmesg", "Show the kernel log", mon_dmesg },
+	{ "ktrace", "Show the last trace records", mon_ktrace },
+	{ "fmtbench", "Time number formatting", mon_fmtbench },
+	{ "symcache", "Show or reset symbol lookup cache statistics", mon_symcache },
+	{ "addr", "Show where a function is", mon_addr },
+	{ "disasm-range", "Show a function's code, line by line", mon_disasm_range },
+	{ "profile", "Sample where the kernel spends its time", mon_profile },
+	{ "perf", "Count hardware events while a command runs", mon_perf },
+	{ "strcheck", "Test the string functions on random inputs", mon_strcheck },
 };
 #define NCOMMANDS (sizeof(commands)/sizeof(commands[0]))
 
@@ -76,6 +94,269 @@ mon_backtrace(int argc, char **argv, struct Trapframe *tf)
 	return 0;
 }
 
+int
+mon_boottime(int argc, char **argv, struct Trapframe *tf)
+{
+	boottrace_print();
+	return 0;
+}
+
+int
+mon_baud(int argc, char **argv, struct Trapframe *tf)
+{
+	int r;
+
+	if (argc > 2) {
+		cprintf("Usage: baud [bits-per-second]\n");
+		return 0;
+	}
+	if (argc == 2 && (r = serial_set_baud(strtol(argv[1], 0, 0))) < 0)
+		cprintf("baud: %e (must divide 115200)\n", r);
+	cprintf("Serial console at %d baud\n", serial_baud());
+	return 0;
+}
+
+int
+mon_cons(int argc, char **argv, struct Trapframe *tf)
+{
+	int r;
+
+	if (argc == 3 && (strcmp(argv[2], "on") == 0
+			  || strcmp(argv[2], "off") == 0)) {
+		if ((r = cons_enable(argv[1], strcmp(argv[2], "on") == 0)) < 0)
+			cprintf("cons: %s: %e\n", argv[1], r);
+	} else if (argc != 1) {
+		cprintf("Usage: cons [device on|off]\n");
+		return 0;
+	}
+	cons_print_devices();
+	return 0;
+}
+
+int
+mon_dmesg(int argc, char **argv, struct Trapframe *tf)
+{
+	klog_dump();
+	return 0;
+}
+
+int
+mon_ktrace(int argc, char **argv, struct Trapframe *tf)
+{
+	if (argc > 2) {
+		cprintf("Usage: ktrace [count]\n");
+		return 0;
+	}
+	ktrace_print(argc == 2 ? strtol(argv[1], 0, 0) : 0);
+	return 0;
+}
+
+int
+mon_fmtbench(int argc, char **argv, struct Trapframe *tf)
+{
+	static const struct {
+		const char *fmt;
+		unsigned long long val;
+		bool wide;
+	} tests[] = {
+		{ "%u", 42, 0 },
+		{ "%u", 3141592653U, 0 },
+		{ "%x", 0xdeadbeef, 0 },
+		{ "%o", 0xdeadbeef, 0 },
+		{ "%llu", 18446744073709551557ULL, 1 },
+		{ "%llx", 0xfedcba9876543210ULL, 1 },
+		{ "%llo", 0xfedcba9876543210ULL, 1 },
+	};
+	char buf[32];
+	uint64_t start, t, best;
+	int i, rep, n;
+
+	// Best of 10 runs of 1000 snprintf() calls each
+	cprintf("  %-6s %20s %8s\n", "format", "value", "cycles");
+	for (i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+		best = ~0ULL;
+		for (rep = 0; rep < 10; rep++) {
+			start = read_tsc();
+			for (n = 0; n < 1000; n++)
+				if (tests[i].wide)
+					snprintf(buf, sizeof(buf), tests[i].fmt,
+						 tests[i].val);
+				else
+					snprintf(buf, sizeof(buf), tests[i].fmt,
+						 (unsigned) tests[i].val);
+			t = read_tsc() - start;
+			if (t < best)
+				best = t;
+		}
+		cprintf("  %-6s %20s %8llu\n", tests[i].fmt, buf, best / 1000);
+	}
+	return 0;
+}
+
+int
+mon_symcache(int argc, char **argv, struct Trapframe *tf)
+{
+	uint32_t hits, misses;
+
+	if (argc == 2 && strcmp(argv[1], "reset") == 0)
+		debuginfo_cache_reset();
+	else if (argc != 1) {
+		cprintf("Usage: symcache [reset]\n");
+		return 0;
+	}
+	debuginfo_cache_stats(&hits, &misses);
+	cprintf("Symbol lookups: %u hits, %u misses", hits, misses);
+	if (hits + misses)
+		cprintf(" (%u%% hits)",
+			(uint32_t) (hits * 100ULL / (hits + misses)));
+	cprintf("\n");
+	return 0;
+}
+
+int
+mon_addr(int argc, char **argv, struct Trapframe *tf)
+{
+	struct Fndebuginfo info;
+	int i;
+
+	if (argc < 2) {
+		cprintf("Usage: addr function...\n");
+		return 0;
+	}
+	for (i = 1; i < argc; i++) {
+		if (debuginfo_fn(argv[i], &info) < 0) {
+			cprintf("%s: no such function\n", argv[i]);
+			continue;
+		}
+		cprintf("%s: %08x-%08x (%u bytes) %s:%d\n", info.fn_name,
+			info.fn_start, info.fn_end,
+			info.fn_end - info.fn_start,
+			info.fn_file, info.fn_line);
+	}
+	return 0;
+}
+
+// Print the bytes of the previous line's code, then start the next.
+struct Disasm {
+	uintptr_t addr;		// start of the pending line's code
+	const char *file;
+	int line;
+};
+
+static void
+disasm_flush(struct Disasm *d, uintptr_t end)
+{
+	char buf[CMDBUF_SIZE];
+	int n;
+
+	if (d->file == NULL)
+		return;
+	cprintf("%08x  %s:%d\n", d->addr, d->file, d->line);
+	// Sixteen bytes to a row
+	while (d->addr < end) {
+		n = snprintf(buf, sizeof(buf), "         ");
+		for (; d->addr < end && n < 9 + 16 * 3; d->addr++)
+			n += snprintf(buf + n, sizeof(buf) - n, " %02x",
+				      *(uint8_t *) d->addr);
+		cprintf("%s\n", buf);
+	}
+}
+
+static void
+disasm_line(uintptr_t addr, const char *file, int line, void *arg)
+{
+	struct Disasm *d = arg;
+
+	disasm_flush(d, addr);
+	d->addr = addr;
+	d->file = file;
+	d->line = line;
+}
+
+int
+mon_disasm_range(int argc, char **argv, struct Trapframe *tf)
+{
+	struct Fndebuginfo info;
+	struct Disasm d;
+
+	if (argc != 2) {
+		cprintf("Usage: disasm-range function\n");
+		return 0;
+	}
+	if (debuginfo_fn(argv[1], &info) < 0) {
+		cprintf("%s: no such function\n", argv[1]);
+		return 0;
+	}
+	cprintf("%s: %08x-%08x\n", info.fn_name, info.fn_start, info.fn_end);
+	d.file = NULL;
+	debuginfo_fn_lines(&info, disasm_line, &d);
+	disasm_flush(&d, info.fn_end);
+	return 0;
+}
+
+int
+mon_profile(int argc, char **argv, struct Trapframe *tf)
+{
+	if (argc >= 2 && argc <= 3 && strcmp(argv[1], "start") == 0) {
+		if (profile_start(argc == 3 ? strtol(argv[2], 0, 0)
+				  : PROFILE_HZ) < 0)
+			cprintf("profile: bad sampling rate\n");
+	} else if (argc == 2 && strcmp(argv[1], "stop") == 0)
+		profile_stop();
+	else if (argc >= 2 && argc <= 3 && strcmp(argv[1], "report") == 0)
+		profile_report(argc == 3 ? strtol(argv[2], 0, 0) : 10);
+	else
+		cprintf("Usage: profile start [hz] | stop | report [count]\n");
+	return 0;
+}
+
+int
+mon_perf(int argc, char **argv, struct Trapframe *tf)
+{
+	struct Perfstat ps;
+	int i, r;
+
+	if (argc == 1) {
+		perf_print_info();
+		return 0;
+	}
+	if (argc < 3 || strcmp(argv[1], "stat") != 0) {
+		cprintf("Usage: perf [stat command [args...]]\n");
+		return 0;
+	}
+	for (i = 0; i < NCOMMANDS; i++)
+		if (strcmp(argv[2], commands[i].name) == 0)
+			break;
+	if (i == NCOMMANDS) {
+		cprintf("Unknown command '%s'\n", argv[2]);
+		return 0;
+	}
+
+	perf_start();
+	r = commands[i].func(argc - 2, argv + 2, tf);
+	perf_stop(&ps);
+
+	cprintf("Performance counter stats for '%s':\n", argv[2]);
+	perf_print(&ps);
+	return r;
+}
+
+int
+mon_strcheck(int argc, char **argv, struct Trapframe *tf)
+{
+	uint32_t n, seed;
+
+	if (argc > 3) {
+		cprintf("Usage: strcheck [cases [seed]]\n");
+		return 0;
+	}
+	n = argc >= 2 ? strtol(argv[1], 0, 0) : 100000;
+	seed = argc == 3 ? strtol(argv[2], 0, 0) : read_tsc();
+	cprintf("Checking %u cases from seed %u\n", n, seed);
+	if (strcheck(n, seed) == 0)
+		cprintf("All passed\n");
+	return 0;
+}
 
 
 /***** Kernel monitor command interpreter *****/
@@ -129,9 +410,14 @@ monitor(struct Trapframe *tf)
 
 	cprintf("Welcome to the JOS kernel monitor!\n");
 	cprintf("Type 'help' for a list of commands.\n");
-
+	// Console output is deferred; count writing out the boot
+	// messages as part of the time to the first prompt.
+	klog_drain();
+	boottrace_end("monitor");
 
 	while (1) {
+		// Show everything logged so far before prompting.
+		klog_drain();
 		buf = readline("K> ");
 		if (buf != NULL)
 			if (runcmd(buf, tf) < 0)
@@ -15,5 +15,17 @@ void monitor(struct Trapframe *tf);
 int mon_help(int argc, char **argv, struct Trapframe *tf);
 int mon_kerninfo(int argc, char **argv, struct Trapframe *tf);
 int mon_backtrace(int argc, char **argv, struct Trapframe *tf);
+int mon_boottime(int argc, char **argv, struct Trapframe *tf);
+int mon_baud(int argc, char **argv, struct Trapframe *tf);
+int mon_cons(int argc, char **argv, struct Trapframe *tf);
+int mon_dmesg(int argc, char **argv, struct Trapframe *tf);
+int mon_ktrace(int argc, char **argv, struct Trapframe *tf);
+int mon_fmtbench(int argc, char **argv, struct Trapframe *tf);
+int mon_symcache(int argc, char **argv, struct Trapframe *tf);
+int mon_addr(int argc, char **argv, struct Trapframe *tf);
+int mon_disasm_range(int argc, char **argv, struct Trapframe *tf);
+int mon_profile(int argc, char **argv, struct Trapframe *tf);
+int mon_perf(int argc, char **argv, struct Trapframe *tf);
+int mon_strcheck(int argc, char **argv, struct Trapframe *tf);
 
 #endif	// !JOS_KERN_MONITOR_H
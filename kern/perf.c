@@ -0,0 +1,152 @@
+// Architectural performance monitoring.
+//
+// CPUID leaf 0xA says which version of the architectural PMU the
+// CPU has, how many general-purpose counters, how wide they are, and
+// which of the predefined architectural events it can count.  Each
+// counter i is programmed through IA32_PERFEVTSELi, and read with
+// RDPMC (allowed at CPL 0 whatever CR4_PCE says).  Version 2 and up
+// also gate every counter through IA32_PERF_GLOBAL_CTRL.
+
+#include <inc/stdio.h>
+#include <inc/string.h>
+#include <inc/x86.h>
+
+#include <kern/perf.h>
+#include <kern/tsc.h>
+
+#define MSR_PERFEVTSEL0		0x186	// IA32_PERFEVTSELx
+#define   PERFEVTSEL_USR	(1 << 16)	// count at CPL > 0
+#define   PERFEVTSEL_OS		(1 << 17)	// count at CPL 0
+#define   PERFEVTSEL_EN		(1 << 22)	// enable the counter
+#define MSR_PMC0		0x0C1	// IA32_PMCx
+#define MSR_PERF_GLOBAL_CTRL	0x38F
+
+// Architectural events, most wanted first.  'bit' is the event's bit
+// in CPUID.0AH:EBX, which is set if the CPU cannot count it.
+static const struct Perfevent {
+	const char *name;
+	uint8_t event;
+	uint8_t umask;
+	uint8_t bit;
+} events[] = {
+	{ "cycles",		0x3C, 0x00, 0 },
+	{ "instructions",	0xC0, 0x00, 1 },
+	{ "LLC-misses",		0x2E, 0x41, 4 },
+	{ "branch-misses",	0xC5, 0x00, 6 },
+	{ "LLC-references",	0x2E, 0x4F, 3 },
+	{ "branches",		0xC4, 0x00, 5 },
+	{ "ref-cycles",		0x3C, 0x01, 2 },
+};
+#define NEVENTS (sizeof(events) / sizeof(events[0]))
+
+static struct {
+	bool probed;
+	int version;			// 0 if there is no architectural PMU
+	int ncounter;			// general-purpose counters
+	int width;			// bits per counter
+	int nevent;			// events programmed, one per counter
+	const struct Perfevent *event[PERF_MAXEVENTS];
+	uint64_t tsc;			// when perf_start() was called
+} pmu;
+
+static void
+perf_probe(void)
+{
+	uint32_t max, eax, ebx;
+	int i;
+
+	pmu.probed = 1;
+	cpuid(0, &max, NULL, NULL, NULL);
+	if (max < 0xA)
+		return;
+	cpuid(0xA, &eax, &ebx, NULL, NULL);
+	pmu.version = eax & 0xFF;
+	pmu.ncounter = (eax >> 8) & 0xFF;
+	pmu.width = (eax >> 16) & 0xFF;
+	if (pmu.version == 0 || pmu.ncounter == 0)
+		return;
+
+	// Bits of EBX past its stated length (EAX[31:24]) mean nothing.
+	for (i = 0; i < NEVENTS && pmu.nevent < pmu.ncounter
+		     && pmu.nevent < PERF_MAXEVENTS; i++)
+		if (events[i].bit < (eax >> 24) && !(ebx & (1 << events[i].bit)))
+			pmu.event[pmu.nevent++] = &events[i];
+}
+
+void
+perf_start(void)
+{
+	int i;
+
+	if (!pmu.probed)
+		perf_probe();
+
+	if (pmu.version >= 2)
+		wrmsr(MSR_PERF_GLOBAL_CTRL, 0);
+	for (i = 0; i < pmu.nevent; i++) {
+		wrmsr(MSR_PERFEVTSEL0 + i, 0);
+		wrmsr(MSR_PMC0 + i, 0);
+		wrmsr(MSR_PERFEVTSEL0 + i,
+		      pmu.event[i]->event | (pmu.event[i]->umask << 8)
+		      | PERFEVTSEL_USR | PERFEVTSEL_OS | PERFEVTSEL_EN);
+	}
+	if (pmu.version >= 2)
+		wrmsr(MSR_PERF_GLOBAL_CTRL, (1ULL << pmu.nevent) - 1);
+	pmu.tsc = read_tsc();
+}
+
+void
+perf_stop(struct Perfstat *ps)
+{
+	uint64_t mask;
+	int i;
+
+	ps->tsc = read_tsc() - pmu.tsc;
+	if (pmu.version >= 2)
+		wrmsr(MSR_PERF_GLOBAL_CTRL, 0);
+	mask = pmu.width < 64 ? (1ULL << pmu.width) - 1 : ~0ULL;
+	for (i = 0; i < pmu.nevent; i++) {
+		wrmsr(MSR_PERFEVTSEL0 + i, 0);
+		ps->name[i] = pmu.event[i]->name;
+		ps->count[i] = rdpmc(i) & mask;
+	}
+	ps->nevent = pmu.nevent;
+}
+
+void
+perf_print(const struct Perfstat *ps)
+{
+	int i;
+
+	for (i = 0; i < ps->nevent; i++) {
+		cprintf("  %16llu  %s", ps->count[i], ps->name[i]);
+		// Instructions per cycle, to two places
+		if (strcmp(ps->name[i], "instructions") == 0
+		    && strcmp(ps->name[0], "cycles") == 0 && ps->count[0])
+			cprintf("  (%llu.%02llu per cycle)",
+				ps->count[i] / ps->count[0],
+				ps->count[i] * 100 / ps->count[0] % 100);
+		cprintf("\n");
+	}
+	cprintf("  %16llu  TSC cycles (%llu us)\n", ps->tsc,
+		tsc_to_us(ps->tsc));
+}
+
+void
+perf_print_info(void)
+{
+	int i;
+
+	if (!pmu.probed)
+		perf_probe();
+	if (pmu.version == 0 || pmu.ncounter == 0) {
+		cprintf("No architectural performance counters\n");
+		return;
+	}
+	cprintf("Architectural PMU version %d: %d counters, %d bits wide\n",
+		pmu.version, pmu.ncounter, pmu.width);
+	cprintf("Counting:");
+	for (i = 0; i < pmu.nevent; i++)
+		cprintf(" %s", pmu.event[i]->name);
+	cprintf("\n");
+}
@@ -0,0 +1,36 @@
+#ifndef JOS_KERN_PERF_H
+#define JOS_KERN_PERF_H
+#ifndef JOS_KERNEL
+# error "This is a JOS kernel header; user programs should not #include it"
+#endif
+
+#include <inc/types.h>
+
+// Hardware performance counters.  perf_start() zeroes and starts as
+// many of the architectural events as the CPU has counters for;
+// perf_stop() stops them and collects the counts.  Anything run in
+// between is measured, for example:
+//
+//	struct Perfstat ps;
+//	perf_start();
+//	do_something();
+//	perf_stop(&ps);
+//	perf_print(&ps);
+//
+// On CPUs (or emulators) without an architectural PMU, only the
+// elapsed TSC cycles are reported.
+#define PERF_MAXEVENTS	8
+
+struct Perfstat {
+	uint64_t tsc;			// elapsed time stamp counter cycles
+	int nevent;			// number of counts below
+	const char *name[PERF_MAXEVENTS];
+	uint64_t count[PERF_MAXEVENTS];
+};
+
+void perf_start(void);
+void perf_stop(struct Perfstat *ps);
+void perf_print(const struct Perfstat *ps);
+void perf_print_info(void);
+
+#endif	// !JOS_KERN_PERF_H
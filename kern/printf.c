@@ -1,25 +1,27 @@
 // Simple implementation of cprintf console output for the kernel,
-// based on printfmt() and the kernel console's cputchar().
+// based on vbprintfmt() and the kernel log's klog_write().
 
 #include <inc/types.h>
 #include <inc/stdio.h>
 #include <inc/stdarg.h>
 
+#include <kern/klog.h>
+
 
 static void
-putch(int ch, int *cnt)
+flushlog(const char *buf, int len, void *dat)
 {
-	cputchar(ch);
-	*cnt++;
+	klog_write(buf, len);
 }
 
 int
 vcprintf(const char *fmt, va_list ap)
 {
-	int cnt = 0;
+	// Assemble the output on the stack and hand it to the log
+	// a buffer at a time, rather than a character at a time.
+	char buf[256];
 
-	vprintfmt((void*)putch, &cnt, fmt, ap);
-	return cnt;
+	return vbprintfmt(flushlog, NULL, buf, sizeof(buf), fmt, ap);
 }
 
 int
@@ -0,0 +1,262 @@
+// Statistical sampling profiler.
+//
+// Channel 0 of the 8253/8254 interval timer raises IRQ 0 at the
+// sampling rate.  The kernel has no trap handling of its own yet, so
+// while profiling we load a small IDT of our own that covers just the
+// sixteen hardware interrupt vectors, with every IRQ but the timer's
+// masked at the 8259A interrupt controllers.
+//
+// Each timer interrupt goes to profile_intr (kern/profentry.S), which
+// hands the saved registers to profile_tick().  That stores the
+// interrupted EIP and the return addresses of up to PROFILE_DEPTH - 1
+// callers, found by following the saved %ebp chain, in a ring of
+// samples.  Nothing is symbolized until profile_report().
+
+#include <inc/stdio.h>
+#include <inc/string.h>
+#include <inc/error.h>
+#include <inc/assert.h>
+#include <inc/mmu.h>
+#include <inc/memlayout.h>
+#include <inc/x86.h>
+
+#include <kern/profile.h>
+#include <kern/kdebug.h>
+
+#define NPROFILE	4096	// samples kept; must be a power of 2
+#define PROFILE_DEPTH	4	// addresses per sample: EIP, then callers
+#define NPROFILEFN	128	// distinct functions profile_report() tallies
+
+// 8259A interrupt controllers
+#define IO_PIC1		0x20	// master (IRQs 0-7)
+#define IO_PIC2		0xA0	// slave (IRQs 8-15)
+#define   PIC_EOI	0x20	//   OCW2: non-specific end of interrupt
+#define IRQ_OFFSET	32	// IRQ 0 comes in on this vector
+#define IRQ_TIMER	0
+
+// 8253/8254 interval timer; see also kern/tsc.c
+#define PIT_HZ		1193182
+#define PIT_CH0		0x40	// channel 0 counter
+#define PIT_MODE	0x43	// mode/command register
+
+// The registers profile_intr saves: a pushal, above the hardware's
+// interrupt frame.
+struct Profframe {
+	uint32_t edi, esi, ebp, oesp, ebx, edx, ecx, eax;
+	uint32_t eip, cs, eflags;
+};
+
+struct Profsample {
+	uintptr_t pc[PROFILE_DEPTH];	// unused entries are 0
+};
+
+static struct {
+	bool on;
+	uint32_t hz;
+	uint32_t next;			// samples ever taken
+	struct Profsample s[NPROFILE];
+} prof;
+
+static struct Gatedesc idt[IRQ_OFFSET + 16];
+static struct Pseudodesc idt_pd = {
+	sizeof(idt) - 1, (uint32_t) idt
+};
+
+extern char bootstack[], bootstacktop[];
+extern const char etext[];
+
+// Could 'pc' be in the kernel's code?
+#define KERNEL_PC(pc)	((pc) >= KERNBASE && (pc) < (uintptr_t) etext)
+
+void profile_intr(void);
+void profile_spurious(void);
+
+void
+profile_tick(struct Profframe *tf)
+{
+	struct Profsample *s;
+	uint32_t *ebp;
+	int d;
+
+	s = &prof.s[prof.next++ % NPROFILE];
+	s->pc[0] = KERNEL_PC(tf->eip) ? tf->eip : 0;
+	// Only believe frame pointers that point into the kernel stack,
+	// and return addresses that point into the kernel's code;
+	// the interrupt may have caught a function before it set up
+	// its frame, or code (libgcc, assembly) that uses %ebp for
+	// something else.  debuginfo_eip() panics on addresses below
+	// KERNBASE.
+	ebp = (uint32_t *) tf->ebp;
+	for (d = 1; s->pc[0] && d < PROFILE_DEPTH; d++) {
+		if ((char *) ebp < bootstack
+		    || (char *) (ebp + 2) > bootstacktop
+		    || ((uintptr_t) ebp & 3)
+		    || !KERNEL_PC(ebp[1]))
+			break;
+		s->pc[d] = ebp[1];
+		ebp = (uint32_t *) ebp[0];
+	}
+	for (; d < PROFILE_DEPTH; d++)
+		s->pc[d] = 0;
+
+	outb(IO_PIC1, PIC_EOI);
+}
+
+static void
+profile_setup(void)
+{
+	uint16_t cs;
+	int i;
+
+	// Whichever segment we are running in (the boot loader's, or
+	// GRUB's) is the one the handlers run in too.
+	__asm __volatile("movw %%cs,%0" : "=r" (cs));
+	for (i = 0; i < 16; i++)
+		SETGATE(idt[IRQ_OFFSET + i], 0, cs,
+			i == IRQ_TIMER ? profile_intr : profile_spurious, 0);
+	lidt(&idt_pd);
+
+	// Remap the controllers' IRQs to vectors IRQ_OFFSET and up, out
+	// of the way of the processor's exceptions, with all masked.
+	outb(IO_PIC1 + 1, 0xFF);
+	outb(IO_PIC2 + 1, 0xFF);
+	outb(IO_PIC1, 0x11);		// ICW1: edge triggered, cascade, ICW4
+	outb(IO_PIC1 + 1, IRQ_OFFSET);	// ICW2: vector offset
+	outb(IO_PIC1 + 1, 1 << 2);	// ICW3: slave on IRQ 2
+	outb(IO_PIC1 + 1, 0x01);	// ICW4: 8086 mode, normal EOI
+	outb(IO_PIC2, 0x11);
+	outb(IO_PIC2 + 1, IRQ_OFFSET + 8);
+	outb(IO_PIC2 + 1, 2);		// ICW3: our cascade identity
+	outb(IO_PIC2 + 1, 0x01);
+	outb(IO_PIC1 + 1, 0xFF);	// OCW1: mask everything
+	outb(IO_PIC2 + 1, 0xFF);
+}
+
+// Start sampling 'hz' times a second, discarding earlier samples.
+int
+profile_start(uint32_t hz)
+{
+	uint32_t latch;
+
+	static_assert((NPROFILE & (NPROFILE - 1)) == 0);
+
+	if (hz == 0 || hz > PIT_HZ || PIT_HZ / hz > 0xFFFF)
+		return -E_INVAL;
+	latch = PIT_HZ / hz;
+
+	__asm __volatile("cli" : : : "memory");
+	if (!prof.on)
+		profile_setup();
+	prof.on = 1;
+	prof.hz = PIT_HZ / latch;
+	prof.next = 0;
+
+	// channel 0, lobyte/hibyte access, mode 2 (rate generator), binary
+	outb(PIT_MODE, 0x34);
+	outb(PIT_CH0, latch & 0xFF);
+	outb(PIT_CH0, latch >> 8);
+
+	outb(IO_PIC1 + 1, 0xFF & ~(1 << IRQ_TIMER));
+	__asm __volatile("sti" : : : "memory");
+	return 0;
+}
+
+// Stop sampling; the samples stay until the next profile_start().
+void
+profile_stop(void)
+{
+	if (!prof.on)
+		return;
+	__asm __volatile("cli" : : : "memory");
+	outb(IO_PIC1 + 1, 0xFF);
+	prof.on = 0;
+}
+
+struct Proffn {
+	uintptr_t addr;
+	const char *name;
+	int namelen;
+	uint32_t self;		// samples taken in the function itself
+	uint32_t total;		// samples with it anywhere on the stack
+};
+
+static struct Proffn *
+proffn_find(struct Proffn *fn, int *nfn, uintptr_t pc)
+{
+	struct Eipdebuginfo info;
+	int i;
+
+	debuginfo_eip(pc, &info);
+	for (i = 0; i < *nfn; i++)
+		if (fn[i].addr == info.eip_fn_addr)
+			return &fn[i];
+	if (*nfn == NPROFILEFN)
+		return NULL;
+	fn[i].addr = info.eip_fn_addr;
+	fn[i].name = info.eip_fn_name;
+	fn[i].namelen = info.eip_fn_namelen;
+	fn[i].self = fn[i].total = 0;
+	(*nfn)++;
+	return &fn[i];
+}
+
+// Print the 'n' functions with the most samples, busiest first.
+void
+profile_report(int n)
+{
+	static struct Proffn fn[NPROFILEFN];
+	struct Proffn *f, *seen[PROFILE_DEPTH], t;
+	uint32_t nsample, i, other = 0;
+	int nfn = 0, d, j, k;
+
+	nsample = MIN(prof.next, (uint32_t) NPROFILE);
+	if (nsample == 0) {
+		cprintf("No samples\n");
+		return;
+	}
+
+	for (i = 0; i < nsample; i++) {
+		// Samples taken outside the kernel's code
+		if (prof.s[i].pc[0] == 0)
+			other++;
+		for (d = 0; d < PROFILE_DEPTH && prof.s[i].pc[d]; d++) {
+			seen[d] = f = proffn_find(fn, &nfn, prof.s[i].pc[d]);
+			if (f == NULL) {
+				if (d == 0)
+					other++;
+				continue;
+			}
+			if (d == 0)
+				f->self++;
+			// Count recursive functions once per sample.
+			for (j = 0; j < d && seen[j] != f; j++)
+				/* do nothing */;
+			if (j == d)
+				f->total++;
+		}
+	}
+
+	// Insertion sort, by self samples
+	for (j = 1; j < nfn; j++) {
+		t = fn[j];
+		for (k = j; k > 0 && fn[k - 1].self < t.self; k--)
+			fn[k] = fn[k - 1];
+		fn[k] = t;
+	}
+
+	cprintf("%u samples at %u Hz", nsample, prof.hz);
+	if (prof.next > nsample)
+		cprintf(" (latest of %u)", prof.next);
+	cprintf("%s\n", prof.on ? ", still running" : "");
+	cprintf("  self%%   self  total  function\n");
+	if (n <= 0 || n > nfn)
+		n = nfn;
+	for (j = 0; j < n && fn[j].self; j++)
+		cprintf("  %3u.%u %6u %6u  %.*s (%08x)\n",
+			fn[j].self * 100 / nsample,
+			fn[j].self * 1000 / nsample % 10,
+			fn[j].self, fn[j].total,
+			fn[j].namelen, fn[j].name, fn[j].addr);
+	if (other)
+		cprintf("  %u samples in other functions\n", other);
+}
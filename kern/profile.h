@@ -0,0 +1,22 @@
+#ifndef JOS_KERN_PROFILE_H
+#define JOS_KERN_PROFILE_H
+#ifndef JOS_KERNEL
+# error "This is a JOS kernel header; user programs should not #include it"
+#endif
+
+#include <inc/types.h>
+
+// Statistical profiler.  profile_start(hz) makes the timer interrupt
+// the kernel 'hz' times a second; each interrupt records where the
+// kernel was, and a few of its callers.  profile_stop() turns the
+// timer off again, and profile_report(n) shows the n functions that
+// were found running most often.
+// Profiling is the only thing in the kernel that runs with interrupts
+// enabled, so it should not be left on for longer than needed.
+#define PROFILE_HZ	1000	// default sampling rate
+
+int profile_start(uint32_t hz);
+void profile_stop(void);
+void profile_report(int n);
+
+#endif	// !JOS_KERN_PROFILE_H
@@ -0,0 +1,243 @@
+// Randomized check of the string routines in lib/string.c.
+//
+// The library versions work a word (or a vector register) at a time,
+// which makes them fast and fiddly.  Here they are run against plain
+// byte-at-a-time versions, on random strings and memory ranges at
+// every alignment, and must agree.
+
+#include <inc/stdio.h>
+#include <inc/string.h>
+
+#include <kern/strcheck.h>
+
+#define MAXLEN		96	// longest string tried
+#define SLOP		8	// room for misalignment and junk
+#define MEMMAX		4096	// longest memset() or memmove() tried
+#define MEMSLOP		64
+
+static char buf[2][MAXLEN + 2 * SLOP];
+static char mbuf[3][MEMMAX + 2 * MEMSLOP];
+static uint32_t seed;
+
+// xorshift32
+static uint32_t
+rand(void)
+{
+	seed ^= seed << 13;
+	seed ^= seed >> 17;
+	seed ^= seed << 5;
+	return seed;
+}
+
+// A non-null character, often one of a few, so that searches hit
+// and comparisons run long; sometimes with the high bit set.
+static char
+randchar(void)
+{
+	static const char common[] = "aab\x80\xff";
+
+	if (rand() % 4)
+		return common[rand() % (sizeof(common) - 1)];
+	return 1 + rand() % 255;
+}
+
+// Byte-at-a-time reference versions
+
+static int
+ref_strnlen(const char *s, size_t size)
+{
+	int n;
+
+	for (n = 0; size > 0 && *s != '\0'; s++, size--)
+		n++;
+	return n;
+}
+
+static char *
+ref_strfind(const char *s, char c)
+{
+	for (; *s; s++)
+		if (*s == c)
+			break;
+	return (char *) s;
+}
+
+static int
+ref_strcmp(const char *p, const char *q)
+{
+	while (*p && *p == *q)
+		p++, q++;
+	return (int) ((unsigned char) *p - (unsigned char) *q);
+}
+
+// Put a random string of length 'len' at 'offset' in 'b',
+// with random junk all around it.
+static char *
+randstr(char *b, int offset, int len)
+{
+	int i;
+
+	for (i = 0; i < sizeof(buf[0]); i++)
+		b[i] = randchar();
+	b[offset + len] = '\0';
+	return b + offset;
+}
+
+static int
+ref_memcmp(const void *v1, const void *v2, size_t n)
+{
+	const uint8_t *s1 = (const uint8_t *) v1;
+	const uint8_t *s2 = (const uint8_t *) v2;
+
+	for (; n > 0; s1++, s2++, n--)
+		if (*s1 != *s2)
+			return (int) *s1 - (int) *s2;
+	return 0;
+}
+
+static void *
+ref_memfind(const void *v, int c, size_t n)
+{
+	const uint8_t *s = (const uint8_t *) v;
+
+	for (; n > 0; s++, n--)
+		if (*s == (uint8_t) c)
+			break;
+	return (void *) s;
+}
+
+// A length from 0 to MEMMAX, as likely to be short as long
+static int
+randlen(void)
+{
+	return rand() % ((MEMMAX >> (rand() % 13)) + 1);
+}
+
+// Is b[0..n) the same as ref[0..n)?
+static bool
+same(const char *b, const char *ref, int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++)
+		if (b[i] != ref[i])
+			return 0;
+	return 1;
+}
+
+static int
+fail(const char *what, uint32_t n, const char *s, int len)
+{
+	cprintf("strcheck: case %u: %s wrong for %p (length %d)\n",
+		n, what, s, len);
+	return -1;
+}
+
+// Check memset() and memmove() on random ranges of mbuf[0], against
+// byte-at-a-time versions run on its copy in mbuf[2].  Then check
+// memcmp() and memfind() on the results.
+static int
+memcheck(uint32_t k)
+{
+	char *b = mbuf[0], *ref = mbuf[2], *src, c;
+	int size = sizeof(mbuf[0]), i, len, soff, doff;
+
+	len = randlen();
+	doff = rand() % (size - len + 1);
+	c = randchar();
+	memset(b + doff, c, len);
+	for (i = 0; i < len; i++)
+		ref[doff + i] = c;
+	if (!same(b, ref, size))
+		return fail("memset", k, b + doff, len);
+
+	// Within one buffer, overlapping or not, then between two
+	len = randlen();
+	soff = rand() % (size - len + 1);
+	doff = rand() % (size - len + 1);
+	memmove(b + doff, b + soff, len);
+	if (doff > soff)
+		for (i = len - 1; i >= 0; i--)
+			ref[doff + i] = ref[soff + i];
+	else
+		for (i = 0; i < len; i++)
+			ref[doff + i] = ref[soff + i];
+	if (!same(b, ref, size))
+		return fail("memmove", k, b + doff, len);
+
+	src = mbuf[1] + rand() % MEMSLOP;
+	for (i = 0; i < len; i++)
+		src[i] = randchar();
+	memmove(b + doff, src, len);
+	if (!same(b + doff, src, len) || !same(b, ref, doff)
+	    || !same(b + doff + len, ref + doff + len, size - doff - len))
+		return fail("memmove", k, b + doff, len);
+	for (i = 0; i < len; i++)
+		ref[doff + i] = src[i];
+
+	// Compare the copy with itself at another alignment, maybe
+	// with one byte changed, and look for a byte that's in it
+	// (or, sometimes, one chosen at random).
+	len = randlen();
+	soff = rand() % (size - len + 1);
+	src = mbuf[1] + rand() % MEMSLOP;
+	memmove(src, b + soff, len);
+	if (len > 0 && rand() % 2)
+		src[rand() % len] = randchar();
+	if (memcmp(b + soff, src, len) != ref_memcmp(b + soff, src, len)
+	    || memcmp(src, b + soff, len) != ref_memcmp(src, b + soff, len))
+		return fail("memcmp", k, src, len);
+
+	c = len > 0 && rand() % 4 ? src[rand() % len] : randchar();
+	if (memfind(src, c, len) != ref_memfind(src, c, len))
+		return fail("memfind", k, src, len);
+	return 0;
+}
+
+// Run 'n' random cases, starting from 'start_seed'.
+// Returns 0 if all agree, -1 after reporting the first that doesn't.
+int
+strcheck(uint32_t n, uint32_t start_seed)
+{
+	char *s, *t, c;
+	int len, tlen, i;
+	size_t size;
+	uint32_t k;
+
+	seed = start_seed ? start_seed : 1;
+	for (i = 0; i < sizeof(mbuf[0]); i++)
+		mbuf[2][i] = mbuf[0][i] = randchar();
+	for (k = 0; k < n; k++) {
+		len = rand() % (MAXLEN + 1);
+		s = randstr(buf[0], rand() % SLOP, len);
+
+		if (strlen(s) != len)
+			return fail("strlen", k, s, len);
+		size = rand() % (MAXLEN + SLOP);
+		if (strnlen(s, size) != ref_strnlen(s, size))
+			return fail("strnlen", k, s, len);
+
+		c = rand() % 8 ? randchar() : '\0';
+		if (strfind(s, c) != ref_strfind(s, c))
+			return fail("strfind", k, s, len);
+		if (strchr(s, c) != (*ref_strfind(s, c) ? ref_strfind(s, c) : 0))
+			return fail("strchr", k, s, len);
+
+		// The other string: a copy, maybe changed or cut short,
+		// at its own alignment
+		t = buf[1] + rand() % SLOP;
+		memmove(t, s, len + 1);
+		if (len > 0 && rand() % 2) {
+			i = rand() % len;
+			t[i] = rand() % 4 ? randchar() : '\0';
+		}
+		tlen = ref_strnlen(t, MAXLEN + 1);
+		if (strcmp(s, t) != ref_strcmp(s, t)
+		    || strcmp(t, s) != ref_strcmp(t, s))
+			return fail("strcmp", k, t, tlen);
+
+		if (memcheck(k) < 0)
+			return -1;
+	}
+	return 0;
+}
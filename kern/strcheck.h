@@ -0,0 +1,11 @@
+#ifndef JOS_KERN_STRCHECK_H
+#define JOS_KERN_STRCHECK_H
+#ifndef JOS_KERNEL
+# error "This is a JOS kernel header; user programs should not #include it"
+#endif
+
+#include <inc/types.h>
+
+int strcheck(uint32_t n, uint32_t seed);
+
+#endif	// !JOS_KERN_STRCHECK_H
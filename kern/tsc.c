@@ -0,0 +1,71 @@
+// Time stamp counter calibration.
+// The TSC counts at a CPU-specific rate, so we time it against
+// channel 2 of the 8253/8254 programmable interval timer,
+// whose input clock is a fixed 1.193182 MHz on every PC.
+
+#include <inc/x86.h>
+
+#include <kern/tsc.h>
+
+#define PIT_HZ		1193182
+#define PIT_CH2		0x42	// channel 2 counter
+#define PIT_MODE	0x43	// mode/command register
+#define PIT_GATE	0x61	// NMI status and control ("port B")
+#define   GATE_CH2	0x01	//   channel 2 gate input
+#define   GATE_SPKR	0x02	//   speaker data enable
+#define   GATE_OUT2	0x20	//   channel 2 output (read-only)
+
+#define CALIBRATE_MS	10
+// Give up on OUT2 after this many TSC cycles: a second or more on any
+// CPU, where CALIBRATE_MS should take a few tens of millions at most.
+#define CALIBRATE_TIMEOUT (1ULL << 30)
+
+static bool calibrated;
+static uint32_t khz;		// 0 if calibration failed
+
+// Returns 0 if the timer never signals the end of the interval,
+// as on machines (or emulators) where channel 2 isn't wired up.
+static uint32_t
+tsc_calibrate(void)
+{
+	uint32_t latch = PIT_HZ / (1000 / CALIBRATE_MS);
+	uint64_t t0, t1;
+
+	// Let channel 2 count, but keep the speaker quiet.
+	outb(PIT_GATE, (inb(PIT_GATE) & ~GATE_SPKR) | GATE_CH2);
+	// channel 2, lobyte/hibyte access, mode 0 (interrupt on terminal
+	// count), binary: OUT2 goes high once 'latch' ticks have elapsed.
+	outb(PIT_MODE, 0xB0);
+	outb(PIT_CH2, latch & 0xFF);
+	outb(PIT_CH2, latch >> 8);
+
+	t0 = read_tsc();
+	do {
+		t1 = read_tsc();
+		if (t1 - t0 > CALIBRATE_TIMEOUT)
+			return 0;
+	} while (!(inb(PIT_GATE) & GATE_OUT2));
+
+	return (t1 - t0) / CALIBRATE_MS;
+}
+
+// Return the TSC rate in kHz, calibrating on first use
+// (which takes CALIBRATE_MS milliseconds), or 0 if it is unknown.
+uint32_t
+tsc_khz(void)
+{
+	if (!calibrated) {
+		khz = tsc_calibrate();
+		calibrated = 1;
+	}
+	return khz;
+}
+
+// Convert TSC cycles to microseconds; 0 if the TSC rate is unknown.
+uint64_t
+tsc_to_us(uint64_t cycles)
+{
+	uint32_t k = tsc_khz();
+
+	return k ? cycles * 1000 / k : 0;
+}
@@ -28,25 +28,193 @@ static const char * const error_string[MAXERROR] =
 	[E_FAULT]	= "segmentation fault",
 };
 
+static const char digits[] = "0123456789abcdef";
+
+// All two-digit decimal numbers, "00" to "99"
+static const char digits2[] =
+	"00010203040506070809"
+	"10111213141516171819"
+	"20212223242526272829"
+	"30313233343536373839"
+	"40414243444546474849"
+	"50515253545556575859"
+	"60616263646566676869"
+	"70717273747576777879"
+	"80818283848586878889"
+	"90919293949596979899";
+
+/*
+ * Convert a 32-bit number to digits in 'base', storing them backwards
+ * from 'end'.  Returns a pointer to the first (most significant) digit.
+ * Decimal goes two digits per division; octal and hex need no division.
+ */
+static char *
+fmtnum32(char *end, uint32_t num, unsigned base)
+{
+	char *p = end;
+	uint32_t r;
+
+	switch (base) {
+	case 10:
+		while (num >= 100) {
+			r = num % 100;
+			num /= 100;
+			p -= 2;
+			p[0] = digits2[2 * r];
+			p[1] = digits2[2 * r + 1];
+		}
+		if (num >= 10) {
+			p -= 2;
+			p[0] = digits2[2 * num];
+			p[1] = digits2[2 * num + 1];
+		} else
+			*--p = '0' + num;
+		break;
+	case 16:
+		do {
+			*--p = digits[num & 15];
+		} while ((num >>= 4) != 0);
+		break;
+	case 8:
+		do {
+			*--p = digits[num & 7];
+		} while ((num >>= 3) != 0);
+		break;
+	default:
+		do {
+			*--p = digits[num % base];
+		} while ((num /= base) != 0);
+		break;
+	}
+	return p;
+}
+
+/*
+ * Same for numbers that may need more than 32 bits.  Only the decimal
+ * case divides 64-bit numbers, once per nine digits; the rest is done
+ * 32 bits at a time.
+ */
+static char *
+fmtnum64(char *end, unsigned long long num, unsigned base)
+{
+	char *p = end;
+	unsigned long long q;
+	char *stop;
+
+	switch (base) {
+	case 10:
+		while (num >> 32) {
+			q = num / 1000000000;
+			stop = p - 9;
+			p = fmtnum32(p, num - q * 1000000000, 10);
+			while (p > stop)
+				*--p = '0';
+			num = q;
+		}
+		return fmtnum32(p, num, 10);
+	case 16:
+		do {
+			*--p = digits[num & 15];
+		} while ((num >>= 4) != 0);
+		return p;
+	case 8:
+		do {
+			*--p = digits[num & 7];
+		} while ((num >>= 3) != 0);
+		return p;
+	default:
+		do {
+			*--p = digits[num % base];
+		} while ((num /= base) != 0);
+		return p;
+	}
+}
+
 /*
- * Print a number (base <= 16) in reverse order,
- * using specified putch function and associated pointer putdat.
+ * Formatted output goes to a Printout.  It is passed either to a putch
+ * function one character at a time, or copied into a buffer a whole
+ * run of characters at a time.  When the buffer fills, it is handed to
+ * 'flush', or if there is none (as for snprintf), the rest of the
+ * output is dropped.  Either way 'cnt' counts every character.
  */
+struct Printout {
+	void (*putch)(int, void*);
+	void (*flush)(const char*, int, void*);
+	void *dat;
+	char *buf, *p, *ebuf;
+	int cnt;
+};
+
 static void
-printnum(void (*putch)(int, void*), void *putdat,
-	 unsigned long long num, unsigned base, int width, int padc)
+emit(struct Printout *o, const char *s, int len)
 {
-	// first recursively print all preceding (more significant) digits
-	if (num >= base) {
-		printnum(putch, putdat, num / base, base, width - 1, padc);
-	} else {
-		// print any needed pad characters before first digit
-		while (--width > 0)
-			putch(padc, putdat);
+	int i, n;
+
+	o->cnt += len;
+	if (o->putch) {
+		while (len-- > 0)
+			o->putch(*s++, o->dat);
+		return;
+	}
+	while (1) {
+		n = MIN(len, o->ebuf - o->p);
+		// Most runs are a few bytes, too short to be worth a memcpy
+		if (n < 16)
+			for (i = 0; i < n; i++)
+				o->p[i] = s[i];
+		else
+			memcpy(o->p, s, n);
+		o->p += n;
+		if ((len -= n) == 0 || !o->flush)
+			return;
+		s += n;
+		o->flush(o->buf, o->p - o->buf, o->dat);
+		o->p = o->buf;
 	}
+}
+
+static void
+emitc(struct Printout *o, int c)
+{
+	char ch = c;
+
+	emit(o, &ch, 1);
+}
+
+// Output 'n' copies of 'c'.
+static void
+pad(struct Printout *o, int c, int n)
+{
+	char pads[16];
+	int i;
+
+	for (i = 0; i < n && i < (int) sizeof(pads); i++)
+		pads[i] = c;
+	for (; n > (int) sizeof(pads); n -= sizeof(pads))
+		emit(o, pads, sizeof(pads));
+	if (n > 0)
+		emit(o, pads, n);
+}
+
+/*
+ * Print a number (base <= 16), padded on the left to 'width'
+ * with 'padc'.
+ */
+static void
+printnum(struct Printout *o, unsigned long long num, unsigned base,
+	 int width, int padc)
+{
+	char buf[24];		// 22 octal digits for 64 bits, and spare
+	char *end = buf + sizeof(buf), *p;
+
+	if (num >> 32)
+		p = fmtnum64(end, num, base);
+	else
+		p = fmtnum32(end, num, base);
 
-	// then print this (the least significant) digit
-	putch("0123456789abcdef"[num % base], putdat);
+	// print any needed pad characters before first digit
+	pad(o, padc, width - (end - p));
+	emit(o, p, end - p);
 }
 
 // Get an unsigned int of various possible sizes from a varargs list,
@@ -76,24 +244,28 @@ getint(va_list *ap, int lflag)
 }
 
 
-// Main function to format and print a string.
-void printfmt(void (*putch)(int, void*), void *putdat, const char *fmt, ...);
+static void oprintf(struct Printout *o, const char *fmt, ...);
 
-void
-vprintfmt(void (*putch)(int, void*), void *putdat, const char *fmt, va_list ap)
+// Main function to format and print a string.
+static void
+doprintfmt(struct Printout *o, const char *fmt, va_list ap)
 {
 	register const char *p;
 	register int ch, err;
+	int i, len;
 	unsigned long long num;
 	int base, lflag, width, precision, altflag;
 	char padc;
 
 	while (1) {
-		while ((ch = *(unsigned char *) fmt++) != '%') {
-			if (ch == '\0')
-				return;
-			putch(ch, putdat);
-		}
+		// Copy out everything up to the next %-escape in one go
+		for (p = fmt; *p != '\0' && *p != '%'; p++)
+			/* do nothing */;
+		if (p > fmt)
+			emit(o, fmt, p - fmt);
+		if (*p == '\0')
+			return;
+		fmt = p + 1;
 
 		// Process a %-escape sequence
 		padc = ' ';
@@ -157,7 +329,7 @@ vprintfmt(void (*putch)(int, void*), void *putdat, const char *fmt, va_list ap)
 
 		// character
 		case 'c':
-			putch(va_arg(ap, int), putdat);
+			emitc(o, va_arg(ap, int));
 			break;
 
 		// error message
@@ -166,32 +338,35 @@ vprintfmt(void (*putch)(int, void*), void *putdat, const char *fmt, va_list ap)
 			if (err < 0)
 				err = -err;
 			if (err >= MAXERROR || (p = error_string[err]) == NULL)
-				printfmt(putch, putdat, "error %d", err);
+				oprintf(o, "error %d", err);
 			else
-				printfmt(putch, putdat, "%s", p);
+				emit(o, p, strlen(p));
 			break;
 
 		// string
 		case 's':
 			if ((p = va_arg(ap, char *)) == NULL)
 				p = "(null)";
-			if (width > 0 && padc != '-')
-				for (width -= strnlen(p, precision); width > 0; width--)
-					putch(padc, putdat);
-			for (; (ch = *p++) != '\0' && (precision < 0 || --precision >= 0); width--)
-				if (altflag && (ch < ' ' || ch > '~'))
-					putch('?', putdat);
-				else
-					putch(ch, putdat);
-			for (; width > 0; width--)
-				putch(' ', putdat);
+			len = strnlen(p, precision);
+			if (padc != '-')
+				pad(o, padc, width - len);
+			if (altflag) {
+				for (i = 0; i < len; i++)
+					if (p[i] < ' ' || p[i] > '~')
+						emitc(o, '?');
+					else
+						emitc(o, p[i]);
+			} else
+				emit(o, p, len);
+			if (padc == '-')
+				pad(o, ' ', width - len);
 			break;
 
 		// (signed) decimal
 		case 'd':
 			num = getint(&ap, lflag);
 			if ((long long) num < 0) {
-				putch('-', putdat);
+				emitc(o, '-');
 				num = -(long long) num;
 			}
 			base = 10;
@@ -205,14 +380,13 @@ vprintfmt(void (*putch)(int, void*), void *putdat, const char *fmt, va_list ap)
 
 		// (unsigned) octal
 		case 'o':
-      num = getuint(&ap, lflag);
-      base = 8;
-      goto number;
+			num = getuint(&ap, lflag);
+			base = 8;
+			goto number;
 
 		// pointer
 		case 'p':
-			putch('0', putdat);
-			putch('x', putdat);
+			emit(o, "0x", 2);
 			num = (unsigned long long)
 				(uintptr_t) va_arg(ap, void *);
 			base = 16;
@@ -223,17 +397,17 @@ vprintfmt(void (*putch)(int, void*), void *putdat, const char *fmt, va_list ap)
 			num = getuint(&ap, lflag);
 			base = 16;
 		number:
-			printnum(putch, putdat, num, base, width, padc);
+			printnum(o, num, base, width, padc);
 			break;
 
 		// escaped '%' character
 		case '%':
-			putch(ch, putdat);
+			emitc(o, ch);
 			break;
 
 		// unrecognized escape sequence - just print it literally
 		default:
-			putch('%', putdat);
+			emitc(o, '%');
 			for (fmt--; fmt[-1] != '%'; fmt--)
 				/* do nothing */;
 			break;
@@ -241,6 +415,24 @@ vprintfmt(void (*putch)(int, void*), void *putdat, const char *fmt, va_list ap)
 	}
 }
 
+static void
+oprintf(struct Printout *o, const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	doprintfmt(o, fmt, ap);
+	va_end(ap);
+}
+
+void
+vprintfmt(void (*putch)(int, void*), void *putdat, const char *fmt, va_list ap)
+{
+	struct Printout o = { putch, NULL, putdat };
+
+	doprintfmt(&o, fmt, ap);
+}
+
 void
 printfmt(void (*putch)(int, void*), void *putdat, const char *fmt, ...)
 {
@@ -251,35 +443,40 @@ printfmt(void (*putch)(int, void*), void *putdat, const char *fmt, ...)
 	va_end(ap);
 }
 
-struct sprintbuf {
-	char *buf;
-	char *ebuf;
-	int cnt;
-};
-
-static void
-sprintputch(int ch, struct sprintbuf *b)
+// Format into the 'size'-byte buffer 'buf', calling flush(buf, len, dat)
+// each time it fills up, and once at the end for whatever is left.
+// Returns the number of characters printed, or -E_INVAL if there is
+// no buffer to format into.
+int
+vbprintfmt(void (*flush)(const char*, int, void*), void *dat,
+	   char *buf, int size, const char *fmt, va_list ap)
 {
-	b->cnt++;
-	if (b->buf < b->ebuf)
-		*b->buf++ = ch;
+	struct Printout o = { NULL, flush, dat, buf, buf, buf + size };
+
+	if (buf == NULL || size < 1)
+		return -E_INVAL;
+
+	doprintfmt(&o, fmt, ap);
+	if (o.p > o.buf)
+		flush(o.buf, o.p - o.buf, dat);
+	return o.cnt;
 }
 
 int
 vsnprintf(char *buf, int n, const char *fmt, va_list ap)
 {
-	struct sprintbuf b = {buf, buf+n-1, 0};
+	struct Printout o = { NULL, NULL, NULL, buf, buf, buf+n-1 };
 
 	if (buf == NULL || n < 1)
 		return -E_INVAL;
 
 	// print the string to the buffer
-	vprintfmt((void*)sprintputch, &b, fmt, ap);
+	doprintfmt(&o, fmt, ap);
 
 	// null terminate the buffer
-	*b.buf = '\0';
+	*o.p = '\0';
 
-	return b.cnt;
+	return o.cnt;
 }
 
 int
@@ -294,5 +491,3 @@ snprintf(char *buf, int n, const char *fmt, ...)
 
 	return rc;
 }
-
-
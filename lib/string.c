@@ -1,6 +1,7 @@
 // Basic string routines.  Not hardware optimized, but not shabby.
 
 #include <inc/string.h>
+#include <inc/x86.h>
 
 // Using assembly for memset/memmove
 // makes some difference on real hardware,
@@ -8,24 +9,54 @@
 // Primespipe runs 3x faster this way.
 #define ASM 1
 
+// The string scanners below look at a word (4 bytes) at a time once
+// they reach a word boundary.  An aligned word never straddles a page,
+// so reading all of the word holding a string's terminating null is
+// safe, even though the bytes after the null may not be ours.
+//
+// HASZERO(w) is nonzero exactly when some byte of 'w' is zero: only a
+// zero byte borrows from its high bit when ONES is subtracted.  The
+// bytes above the first zero can give false positives, so the caller
+// finds the byte with a byte-at-a-time loop.
+typedef uint32_t __attribute__((__may_alias__)) word_t;
+typedef uint32_t __attribute__((__may_alias__, __aligned__(1))) uword_t;
+
+#define ONES		0x01010101U
+#define HIGHS		0x80808080U
+#define HASZERO(w)	(((w) - ONES) & ~(w) & HIGHS)
+#define ALIGNED(p)	(((uintptr_t) (p) & (sizeof(word_t) - 1)) == 0)
+
 int
 strlen(const char *s)
 {
-	int n;
+	const char *p;
+	const word_t *w;
 
-	for (n = 0; *s != '\0'; s++)
-		n++;
-	return n;
+	for (p = s; !ALIGNED(p); p++)
+		if (*p == '\0')
+			return p - s;
+	for (w = (const word_t *) p; !HASZERO(*w); w++)
+		/* do nothing */;
+	for (p = (const char *) w; *p != '\0'; p++)
+		/* do nothing */;
+	return p - s;
 }
 
 int
 strnlen(const char *s, size_t size)
 {
-	int n;
-
-	for (n = 0; size > 0 && *s != '\0'; s++, size--)
-		n++;
-	return n;
+	const char *p;
+	const word_t *w;
+
+	for (p = s; size > 0 && !ALIGNED(p); p++, size--)
+		if (*p == '\0')
+			return p - s;
+	for (w = (const word_t *) p; size >= sizeof(*w) && !HASZERO(*w);
+	     w++, size -= sizeof(*w))
+		/* do nothing */;
+	for (p = (const char *) w; size > 0 && *p != '\0'; p++, size--)
+		/* do nothing */;
+	return p - s;
 }
 
 char *
@@ -79,6 +110,21 @@ strlcpy(char *dst, const char *src, size_t size)
 int
 strcmp(const char *p, const char *q)
 {
+	const word_t *wp, *wq;
+
+	// Compare a word at a time if both strings can be aligned together.
+	if ((((uintptr_t) p ^ (uintptr_t) q) & (sizeof(word_t) - 1)) == 0) {
+		for (; !ALIGNED(p); p++, q++)
+			if (*p == '\0' || *p != *q)
+				goto bytes;
+		wp = (const word_t *) p;
+		wq = (const word_t *) q;
+		for (; *wp == *wq && !HASZERO(*wp); wp++, wq++)
+			/* do nothing */;
+		p = (const char *) wp;
+		q = (const char *) wq;
+	}
+bytes:
 	while (*p && *p == *q)
 		p++, q++;
 	return (int) ((unsigned char) *p - (unsigned char) *q);
@@ -96,45 +142,388 @@ strncmp(const char *p, const char *q, size_t n)
 }
 
 // Return a pointer to the first occurrence of 'c' in 's',
-// or a null pointer if the string has no 'c'.
+// or a pointer to the string-ending null character if the string has no 'c'.
 char *
-strchr(const char *s, char c)
+strfind(const char *s, char c)
 {
-	for (; *s; s++)
-		if (*s == c)
+	const word_t *w;
+	uint32_t cc;
+
+	for (; !ALIGNED(s); s++)
+		if (*s == '\0' || *s == c)
 			return (char *) s;
-	return 0;
+	// A byte equal to c is a zero byte of w ^ cc.
+	cc = (uint8_t) c * ONES;
+	for (w = (const word_t *) s; !HASZERO(*w) && !HASZERO(*w ^ cc); w++)
+		/* do nothing */;
+	for (s = (const char *) w; *s != '\0' && *s != c; s++)
+		/* do nothing */;
+	return (char *) s;
 }
 
 // Return a pointer to the first occurrence of 'c' in 's',
-// or a pointer to the string-ending null character if the string has no 'c'.
+// or a null pointer if the string has no 'c'.
 char *
-strfind(const char *s, char c)
+strchr(const char *s, char c)
 {
-	for (; *s; s++)
-		if (*s == c)
-			break;
-	return (char *) s;
+	s = strfind(s, c);
+	return *s ? (char *) s : 0;
 }
 
 #if ASM
-void *
-memset(void *v, int c, size_t n)
+// memset() and memmove() hand the bulk of their work to a fill and a
+// copy kernel, picked by string_init() from what the CPU supports:
+//
+//	rep	rep stosl/movsl, with any bytes before the destination's
+//		first word boundary and after its last done by rep
+//		stosb/movsb (the only choice before string_init());
+//		just rep stosb/movsb if the CPU has ERMS
+//	erms	rep stosb/movsb, which CPUs with "enhanced rep movsb"
+//		run a cache line at a time whatever the alignment
+//	sse2	16-byte loads and aligned stores, 64 bytes a loop
+//	avx	32-byte loads and aligned stores, 128 bytes a loop
+//
+// The vector kernels leave short jobs to 'rep', and long ones to
+// 'erms' if the CPU has it.  Very long ones, which would only flush
+// the caches, use non-temporal stores that go straight to memory.
+// They clobber the SSE/AVX registers without saving them.  We build
+// without -msse, so the compiler never keeps anything there (and won't
+// let the asm below name them as clobbered); nothing else in the
+// kernel uses them either.
+#define REP_MIN		64		// shortest job worth splitting up
+#define VEC_MIN		64		// shortest job for the sse2 kernels
+#define AVX_MIN		128		// shortest job for the avx kernels
+#define ERMS_MIN	2048		// from here on rep movsb is as fast
+#define NT_MIN		(256 * 1024)	// from here on bypass the caches
+
+static void copy_rep(char *d, const char *s, size_t n);
+static void fill_rep(char *d, uint32_t c, size_t n);
+
+static void (*copy)(char *d, const char *s, size_t n) = copy_rep;
+static void (*fill)(char *d, uint32_t c, size_t n) = fill_rep;
+static bool erms;		// CPU has enhanced rep movsb/stosb
+static bool sse2;		// CPU has SSE2 (and the kernel enabled it)
+
+static void
+copy_words(char *d, const char *s, size_t n)
 {
-	char *p;
+	size_t head, words;
 
-	if (n == 0)
-		return v;
-	if ((int)v%4 == 0 && n%4 == 0) {
-		c &= 0xFF;
-		c = (c<<24)|(c<<16)|(c<<8)|c;
-		asm volatile("cld; rep stosl\n"
-			:: "D" (v), "a" (c), "c" (n/4)
-			: "cc", "memory");
-	} else
+	if (n < REP_MIN) {
+		asm volatile("cld; rep movsb\n"
+			: "+D" (d), "+S" (s), "+c" (n) : : "cc", "memory");
+		return;
+	}
+	// Bytes up to the destination's first word boundary, whole
+	// words, then the bytes left over.  The source may stay
+	// misaligned; that costs far less than going a byte at a time.
+	head = -(uintptr_t) d & 3;
+	words = (n - head) / 4;
+	n = (n - head) % 4;
+	asm volatile("cld; rep movsb\n"
+		"movl %3, %%ecx; rep movsl\n"
+		"movl %4, %%ecx; rep movsb\n"
+		: "+D" (d), "+S" (s), "+c" (head)
+		: "rm" (words), "rm" (n) : "cc", "memory");
+}
+
+static void
+copy_rep(char *d, const char *s, size_t n)
+{
+	// With ERMS, rep movsb does that splitting up itself, faster,
+	// except when the destination is just behind the source.
+	if (erms)
+		asm volatile("cld; rep movsb\n"
+			: "+D" (d), "+S" (s), "+c" (n) : : "cc", "memory");
+	else
+		copy_words(d, s, n);
+}
+
+// Copy backwards, from the end, for a destination that overlaps
+// the end of its source.  Otherwise like copy_words().
+static void
+copy_rep_back(char *d, const char *s, size_t n)
+{
+	size_t tail, words;
+
+	d += n - 1;
+	s += n - 1;
+	if (n < REP_MIN) {
+		asm volatile("std; rep movsb\n"
+			: "+D" (d), "+S" (s), "+c" (n) : : "cc", "memory");
+	} else {
+		// ERMS doesn't speed up backward copies, so we
+		// always split them: bytes after the destination's
+		// last word boundary, whole words, then the bytes
+		// left at the start.
+		// movsl addresses its word by its first byte, so
+		// step back 3 around it.
+		tail = (uintptr_t) (d + 1) & 3;
+		words = (n - tail) / 4;
+		n = (n - tail) % 4;
+		asm volatile("std; rep movsb\n"
+			"subl $3, %%edi; subl $3, %%esi\n"
+			"movl %3, %%ecx; rep movsl\n"
+			"addl $3, %%edi; addl $3, %%esi\n"
+			"movl %4, %%ecx; rep movsb\n"
+			: "+D" (d), "+S" (s), "+c" (tail)
+			: "rm" (words), "rm" (n) : "cc", "memory");
+	}
+	// Some versions of GCC rely on DF being clear
+	asm volatile("cld" ::: "cc");
+}
+
+static void
+copy_erms(char *d, const char *s, size_t n)
+{
+	asm volatile("cld; rep movsb\n"
+		: "+D" (d), "+S" (s), "+c" (n) : : "cc", "memory");
+}
+
+static void
+copy_sse2(char *d, const char *s, size_t n)
+{
+	char *end = d + n;
+	const char *send = s + n;
+	size_t head;
+
+	if (n < VEC_MIN) {
+		copy_rep(d, s, n);
+		return;
+	}
+	if (erms && n >= ERMS_MIN && n < NT_MIN) {
+		copy_erms(d, s, n);
+		return;
+	}
+
+	// Copy the first 16 bytes as they lie, then carry on from
+	// the first 16-byte boundary in the destination.
+	head = -(uintptr_t) d & 15;
+	asm volatile("movdqu (%1), %%xmm0; movdqu %%xmm0, (%0)"
+		: : "r" (d), "r" (s) : "memory");
+	d += head;
+	s += head;
+	n -= head;
+
+	// Full 64-byte blocks
+	if (n >= NT_MIN)
+		asm volatile("1: movdqu (%1), %%xmm0; movdqu 16(%1), %%xmm1\n"
+			"movdqu 32(%1), %%xmm2; movdqu 48(%1), %%xmm3\n"
+			"movntdq %%xmm0, (%0); movntdq %%xmm1, 16(%0)\n"
+			"movntdq %%xmm2, 32(%0); movntdq %%xmm3, 48(%0)\n"
+			"addl $64, %0; addl $64, %1; subl $64, %2\n"
+			"cmpl $64, %2; jae 1b; sfence"
+			: "+r" (d), "+r" (s), "+r" (n) : : "cc", "memory");
+	else
+		asm volatile("cmpl $64, %2; jb 2f\n"
+			"1: movdqu (%1), %%xmm0; movdqu 16(%1), %%xmm1\n"
+			"movdqu 32(%1), %%xmm2; movdqu 48(%1), %%xmm3\n"
+			"movdqa %%xmm0, (%0); movdqa %%xmm1, 16(%0)\n"
+			"movdqa %%xmm2, 32(%0); movdqa %%xmm3, 48(%0)\n"
+			"addl $64, %0; addl $64, %1; subl $64, %2\n"
+			"cmpl $64, %2; jae 1b\n"
+			"2:"
+			: "+r" (d), "+r" (s), "+r" (n) : : "cc", "memory");
+
+	// The last 64 bytes, as they lie, overlapping what's done
+	if (n > 0)
+		asm volatile("movdqu -64(%1), %%xmm0; movdqu -48(%1), %%xmm1\n"
+			"movdqu -32(%1), %%xmm2; movdqu -16(%1), %%xmm3\n"
+			"movdqu %%xmm0, -64(%0); movdqu %%xmm1, -48(%0)\n"
+			"movdqu %%xmm2, -32(%0); movdqu %%xmm3, -16(%0)"
+			: : "r" (end), "r" (send) : "memory");
+}
+
+static void
+copy_avx(char *d, const char *s, size_t n)
+{
+	char *end = d + n;
+	const char *send = s + n;
+	size_t head;
+
+	if (n < AVX_MIN || (erms && n >= ERMS_MIN && n < NT_MIN)) {
+		copy_sse2(d, s, n);
+		return;
+	}
+
+	head = -(uintptr_t) d & 31;
+	asm volatile("vmovdqu (%1), %%ymm0; vmovdqu %%ymm0, (%0)"
+		: : "r" (d), "r" (s) : "memory");
+	d += head;
+	s += head;
+	n -= head;
+
+	if (n >= NT_MIN)
+		asm volatile("1: vmovdqu (%1), %%ymm0; vmovdqu 32(%1), %%ymm1\n"
+			"vmovdqu 64(%1), %%ymm2; vmovdqu 96(%1), %%ymm3\n"
+			"vmovntdq %%ymm0, (%0); vmovntdq %%ymm1, 32(%0)\n"
+			"vmovntdq %%ymm2, 64(%0); vmovntdq %%ymm3, 96(%0)\n"
+			"addl $128, %0; addl $128, %1; subl $128, %2\n"
+			"cmpl $128, %2; jae 1b; sfence"
+			: "+r" (d), "+r" (s), "+r" (n) : : "cc", "memory");
+	else
+		asm volatile("cmpl $128, %2; jb 2f\n"
+			"1: vmovdqu (%1), %%ymm0; vmovdqu 32(%1), %%ymm1\n"
+			"vmovdqu 64(%1), %%ymm2; vmovdqu 96(%1), %%ymm3\n"
+			"vmovdqa %%ymm0, (%0); vmovdqa %%ymm1, 32(%0)\n"
+			"vmovdqa %%ymm2, 64(%0); vmovdqa %%ymm3, 96(%0)\n"
+			"addl $128, %0; addl $128, %1; subl $128, %2\n"
+			"cmpl $128, %2; jae 1b\n"
+			"2:"
+			: "+r" (d), "+r" (s), "+r" (n) : : "cc", "memory");
+
+	if (n > 0)
+		asm volatile("vmovdqu -128(%1), %%ymm0; vmovdqu -96(%1), %%ymm1\n"
+			"vmovdqu -64(%1), %%ymm2; vmovdqu -32(%1), %%ymm3\n"
+			"vmovdqu %%ymm0, -128(%0); vmovdqu %%ymm1, -96(%0)\n"
+			"vmovdqu %%ymm2, -64(%0); vmovdqu %%ymm3, -32(%0)"
+			: : "r" (end), "r" (send) : "memory");
+	// Avoid the AVX-to-SSE transition penalty
+	asm volatile("vzeroupper");
+}
+
+// 'c' is the fill byte repeated four times.
+static void
+fill_rep(char *d, uint32_t c, size_t n)
+{
+	size_t head, words;
+
+	if (n < REP_MIN || erms) {
 		asm volatile("cld; rep stosb\n"
-			:: "D" (v), "a" (c), "c" (n)
-			: "cc", "memory");
+			: "+D" (d), "+c" (n) : "a" (c) : "cc", "memory");
+		return;
+	}
+	head = -(uintptr_t) d & 3;
+	words = (n - head) / 4;
+	n = (n - head) % 4;
+	asm volatile("cld; rep stosb\n"
+		"movl %2, %%ecx; rep stosl\n"
+		"movl %3, %%ecx; rep stosb\n"
+		: "+D" (d), "+c" (head)
+		: "rm" (words), "rm" (n), "a" (c) : "cc", "memory");
+}
+
+static void
+fill_erms(char *d, uint32_t c, size_t n)
+{
+	asm volatile("cld; rep stosb\n"
+		: "+D" (d), "+c" (n) : "a" (c) : "cc", "memory");
+}
+
+static void
+fill_sse2(char *d, uint32_t c, size_t n)
+{
+	char *end = d + n;
+
+	if (n < VEC_MIN) {
+		fill_rep(d, c, n);
+		return;
+	}
+	if (erms && n >= ERMS_MIN && n < NT_MIN) {
+		fill_erms(d, c, n);
+		return;
+	}
+
+	asm volatile("movd %1, %%xmm0; pshufd $0, %%xmm0, %%xmm0\n"
+		"movdqu %%xmm0, (%0)"
+		: : "r" (d), "r" (c) : "memory");
+	n -= -(uintptr_t) d & 15;
+	d += -(uintptr_t) d & 15;
+
+	if (n >= NT_MIN)
+		asm volatile("1: movntdq %%xmm0, (%0); movntdq %%xmm0, 16(%0)\n"
+			"movntdq %%xmm0, 32(%0); movntdq %%xmm0, 48(%0)\n"
+			"addl $64, %0; subl $64, %1; cmpl $64, %1; jae 1b; sfence"
+			: "+r" (d), "+r" (n) : : "cc", "memory");
+	else
+		asm volatile("cmpl $64, %1; jb 2f\n"
+			"1: movdqa %%xmm0, (%0); movdqa %%xmm0, 16(%0)\n"
+			"movdqa %%xmm0, 32(%0); movdqa %%xmm0, 48(%0)\n"
+			"addl $64, %0; subl $64, %1; cmpl $64, %1; jae 1b\n"
+			"2:"
+			: "+r" (d), "+r" (n) : : "cc", "memory");
+
+	if (n > 0)
+		asm volatile("movdqu %%xmm0, -64(%0); movdqu %%xmm0, -48(%0)\n"
+			"movdqu %%xmm0, -32(%0); movdqu %%xmm0, -16(%0)"
+			: : "r" (end) : "memory");
+}
+
+static void
+fill_avx(char *d, uint32_t c, size_t n)
+{
+	char *end = d + n;
+
+	if (n < AVX_MIN || (erms && n >= ERMS_MIN && n < NT_MIN)) {
+		fill_sse2(d, c, n);
+		return;
+	}
+
+	asm volatile("vbroadcastss %1, %%ymm0; vmovdqu %%ymm0, (%0)"
+		: : "r" (d), "m" (c) : "memory");
+	n -= -(uintptr_t) d & 31;
+	d += -(uintptr_t) d & 31;
+
+	if (n >= NT_MIN)
+		asm volatile("1: vmovntdq %%ymm0, (%0); vmovntdq %%ymm0, 32(%0)\n"
+			"vmovntdq %%ymm0, 64(%0); vmovntdq %%ymm0, 96(%0)\n"
+			"addl $128, %0; subl $128, %1; cmpl $128, %1; jae 1b; sfence"
+			: "+r" (d), "+r" (n) : : "cc", "memory");
+	else
+		asm volatile("cmpl $128, %1; jb 2f\n"
+			"1: vmovdqa %%ymm0, (%0); vmovdqa %%ymm0, 32(%0)\n"
+			"vmovdqa %%ymm0, 64(%0); vmovdqa %%ymm0, 96(%0)\n"
+			"addl $128, %0; subl $128, %1; cmpl $128, %1; jae 1b\n"
+			"2:"
+			: "+r" (d), "+r" (n) : : "cc", "memory");
+
+	if (n > 0)
+		asm volatile("vmovdqu %%ymm0, -128(%0); vmovdqu %%ymm0, -96(%0)\n"
+			"vmovdqu %%ymm0, -64(%0); vmovdqu %%ymm0, -32(%0)"
+			: : "r" (end) : "memory");
+	asm volatile("vzeroupper");
+}
+
+// Pick the copy and fill kernels.  The kernel must already have
+// enabled SSE (CR4_OSFXSR) if the CPU has it; AVX is only used if
+// the OS has turned on its register state in XCR0.
+const char *
+string_init(void)
+{
+	uint32_t max, ebx, ecx, edx;
+
+	cpuid(0, &max, NULL, NULL, NULL);
+	cpuid(1, NULL, NULL, &ecx, &edx);
+	sse2 = (edx & (1 << 26)) != 0;
+	if (max >= 7) {
+		cpuid(7, NULL, &ebx, NULL, NULL);
+		erms = (ebx & (1 << 9)) != 0;
+	}
+
+	// CPUID.1:ECX.OSXSAVE mirrors CR4_OSXSAVE, and XCR0 bits 1
+	// and 2 say the OS saves (so allows) SSE and AVX state.
+	if ((ecx & (1 << 28)) && (ecx & (1 << 27))
+	    && (xgetbv(0) & 6) == 6) {
+		copy = copy_avx;
+		fill = fill_avx;
+		return erms ? "avx+erms" : "avx";
+	} else if (sse2) {
+		copy = copy_sse2;
+		fill = fill_sse2;
+		return erms ? "sse2+erms" : "sse2";
+	} else if (erms) {
+		copy = copy_erms;
+		fill = fill_erms;
+		return "erms";
+	}
+	return "rep";
+}
+
+void *
+memset(void *v, int c, size_t n)
+{
+	c &= 0xFF;
+	fill(v, (c<<24)|(c<<16)|(c<<8)|c, n);
 	return v;
 }
 
@@ -146,30 +535,28 @@ memmove(void *dst, const void *src, size_t n)
 
 	s = src;
 	d = dst;
-	if (s < d && s + n > d) {
-		s += n;
-		d += n;
-		if ((int)s%4 == 0 && (int)d%4 == 0 && n%4 == 0)
-			asm volatile("std; rep movsl\n"
-				:: "D" (d-4), "S" (s-4), "c" (n/4) : "cc", "memory");
-		else
-			asm volatile("std; rep movsb\n"
-				:: "D" (d-1), "S" (s-1), "c" (n) : "cc", "memory");
-		// Some versions of GCC rely on DF being clear
-		asm volatile("cld" ::: "cc");
-	} else {
-		if ((int)s%4 == 0 && (int)d%4 == 0 && n%4 == 0)
-			asm volatile("cld; rep movsl\n"
-				:: "D" (d), "S" (s), "c" (n/4) : "cc", "memory");
+	if (s < d && s + n > d)
+		copy_rep_back(d, s, n);
+	else if (d < s && d + n > s) {
+		// The kernels may read ahead of what they've written,
+		// and ERMS rep movsb is slow on long overlapping copies.
+		if (n >= ERMS_MIN)
+			copy_words(d, s, n);
 		else
-			asm volatile("cld; rep movsb\n"
-				:: "D" (d), "S" (s), "c" (n) : "cc", "memory");
-	}
+			copy_rep(d, s, n);
+	} else
+		copy(d, s, n);
 	return dst;
 }
 
 #else
 
+const char *
+string_init(void)
+{
+	return "bytes";
+}
+
 void *
 memset(void *v, int c, size_t n)
 {
@@ -211,27 +598,70 @@ memcpy(void *dst, const void *src, size_t n)
 	return memmove(dst, src, n);
 }
 
+// Compare a word at a time, with s1 word-aligned (s2 may not be).
+// The lowest differing bit of a mismatched pair of words is in the
+// first differing byte, since x86 is little-endian.
 int
 memcmp(const void *v1, const void *v2, size_t n)
 {
 	const uint8_t *s1 = (const uint8_t *) v1;
 	const uint8_t *s2 = (const uint8_t *) v2;
+	uint32_t x;
+	int i;
 
-	while (n-- > 0) {
+	for (; n > 0 && !ALIGNED(s1); s1++, s2++, n--)
 		if (*s1 != *s2)
 			return (int) *s1 - (int) *s2;
-		s1++, s2++;
+	for (; n >= sizeof(word_t); s1 += 4, s2 += 4, n -= 4) {
+		x = *(const word_t *) s1 ^ *(const uword_t *) s2;
+		if (x) {
+			i = __builtin_ctz(x) / 8;
+			return (int) s1[i] - (int) s2[i];
+		}
 	}
-
+	for (; n > 0; s1++, s2++, n--)
+		if (*s1 != *s2)
+			return (int) *s1 - (int) *s2;
 	return 0;
 }
 
+// Search a word at a time, as strfind() does, or with SSE2 16 bytes
+// at a time.  Only bytes inside the range are ever read.
 void *
-memfind(const void *s, int c, size_t n)
+memfind(const void *v, int c, size_t n)
 {
-	const void *ends = (const char *) s + n;
-	for (; s < ends; s++)
-		if (*(const unsigned char *) s == (unsigned char) c)
+	const uint8_t *s = (const uint8_t *) v;
+	uint32_t cc = (uint8_t) c * ONES;
+
+	for (; n > 0 && !ALIGNED(s); s++, n--)
+		if (*s == (uint8_t) c)
+			return (void *) s;
+#if ASM
+	if (sse2 && n >= 32) {
+		uint32_t mask;
+
+		for (; (uintptr_t) s & 15; s += 4, n -= 4)
+			if (HASZERO(*(const word_t *) s ^ cc))
+				goto bytes;
+		// Compare 16 bytes to 16 copies of c, and make a mask
+		// of the bytes that match.
+		asm volatile("movd %3, %%xmm1; pshufd $0, %%xmm1, %%xmm1\n"
+			"1: movdqa (%0), %%xmm0; pcmpeqb %%xmm1, %%xmm0\n"
+			"pmovmskb %%xmm0, %2; testl %2, %2; jnz 2f\n"
+			"addl $16, %0; subl $16, %1; cmpl $16, %1; jae 1b\n"
+			"2:"
+			: "+r" (s), "+r" (n), "=&r" (mask)
+			: "r" (cc) : "cc", "memory");
+		if (mask)
+			return (void *) (s + __builtin_ctz(mask));
+	}
+#endif
+	for (; n >= sizeof(word_t); s += 4, n -= 4)
+		if (HASZERO(*(const word_t *) s ^ cc))
+			break;
+bytes:
+	for (; n > 0; s++, n--)
+		if (*s == (uint8_t) c)
 			break;
 	return (void *) s;
 }